@@ -0,0 +1,213 @@
+#include "bench.hpp"
+#include <Arduino.h>
+
+#ifdef BENCH_ENABLED
+
+#ifdef ESP32
+#define BENCH_PLATFORM "esp32"
+// test/bench_baseline.json, embedded by board_build.embed_txtfiles
+extern const char benchBaselineStart[] asm("_binary_test_bench_baseline_json_start");
+#else
+#define BENCH_PLATFORM "native"
+#endif
+
+#define LOG_BENCH_ENTRIES 64
+
+// Keeps the compiler from optimizing a benchmarked result away
+static volatile uint32_t benchSink;
+
+// Discards everything written to it, only counts the bytes
+class CountingPrint : public Print {
+public:
+    size_t write(uint8_t) override {
+        bytes++;
+        return 1;
+    }
+    size_t write(const uint8_t*, size_t size) override {
+        bytes += size;
+        return size;
+    }
+
+    uint32_t bytes = 0;
+};
+
+template<typename Body>
+void BenchClass::measure(BenchResult& result, const char* name, uint32_t iterations, Body body) {
+    uint64_t total = 0;
+    result = {name, 0, UINT32_MAX, 0, 0, 0, false};
+
+    body(); // Warm up caches
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        // The cycle counters of the two cores are not in sync
+        int core = xPortGetCoreID();
+        uint32_t start = ESP.getCycleCount();
+        body();
+        uint32_t cycles = ESP.getCycleCount() - start;
+        if (xPortGetCoreID() != core) continue;
+
+        total += cycles;
+        result.iterations++;
+        if (cycles < result.minCycles) result.minCycles = cycles;
+    }
+
+    if (result.iterations == 0) result.minCycles = 0;
+    else result.meanCycles = total / result.iterations;
+}
+
+bool BenchClass::run() {
+    printf("Running benchmarks...\n");
+
+    // Schedule next wakeup, the default schedule at a fixed time (after the last dose, the scan wraps to tomorrow)
+        static const WakeTimestamp schedule[] = {
+            {7, 0, 0, WEEKDAYS_ALL}, {9, 0, 1, WEEKDAYS_ALL}, {11, 0, 2, WEEKDAYS_ALL}, {13, 0, 3, WEEKDAYS_ALL},
+            {15, 0, 4, WEEKDAYS_ALL}, {17, 0, 5, WEEKDAYS_ALL}, {19, 0, 6, WEEKDAYS_ALL}, {21, 0, 7, WEEKDAYS_ALL}
+        };
+        struct tm now = {};
+        now.tm_year = 2025 - 1900;
+        now.tm_mon = 9;  // October
+        now.tm_mday = 15;
+        now.tm_wday = 3; // Wednesday
+        now.tm_hour = 22;
+        now.tm_isdst = -1;
+        measure(results[0], "nextWakeup", 100, [&]() {
+            uint32_t compartments;
+            benchSink = SleepSystemClass::nextWakeupOf(schedule, 8, 8, now, compartments);
+        });
+
+    // Input JSON serialization
+        measure(results[1], "inputJson", 200, [&]() {
+            benchSink = server.inputJson().length();
+        });
+
+    // State route dispatch
+        static const char* uris[] = {"/state/off", "/state/on", "/state/hatch", "/state/phase1",
+                                     "/state/phase2", "/state/phase3", "/state/phase4"};
+        measure(results[2], "stateDispatch", 200, [&]() {
+            for (const char* uri : uris) {
+                OutputState state;
+                String name;
+                benchSink = ServerClass::parseStateUri(uri, state, name);
+            }
+        });
+
+    // Root page loading
+        measure(results[3], "rootPage", 20, [&]() {
+            String html;
+            server.readRootPage(html);
+            benchSink = html.length();
+        });
+
+    // Output pattern step
+        OutputPattern pattern;
+        unsigned long patternTime = 0;
+        measure(results[4], "outputPattern", 1000, [&]() {
+            patternTime += 10;
+            OutputLevels levels = OuptutClass::patternStep(OutputState::NOTIFICATION_PHASE_4, patternTime, 200, 100, pattern);
+            benchSink = levels.buzzer;
+        });
+
+    // Dose log page encoding
+        DoseLogEntry entries[LOG_BENCH_ENTRIES];
+        for (uint32_t i = 0; i < LOG_BENCH_ENTRIES; i++) {
+            entries[i] = {1760000000 + i * 7200, (uint8_t)(i % 3), (uint8_t)(i % 28), 0};
+        }
+        for (int cbor = 1; cbor >= 0; cbor--) {
+            CountingPrint out;
+            BenchResult& result = results[cbor ? 5 : 6];
+            measure(result, cbor ? "logCbor" : "logJson", 100, [&]() {
+                out.bytes = 0;
+                for (uint32_t i = 0; i < LOG_BENCH_ENTRIES; i++) {
+                    ServerClass::writeLogEntry(out, entries[i], cbor, i == 0);
+                }
+            });
+            result.bytes = out.bytes;
+        }
+
+    // Compare against the baseline, a benchmark without one fails too (a run that can't regress checks nothing)
+        loadBaseline();
+        bool pass = true;
+        for (BenchResult& r : results) {
+            r.regressed = r.baselineCycles == 0 ||
+                (uint64_t)r.minCycles * 100 > (uint64_t)r.baselineCycles * (100 + tolerancePercent);
+            if (r.regressed) pass = false;
+            printf(" - %-14s min %8u mean %8u baseline %8u%s\n", r.name, (unsigned)r.minCycles,
+                (unsigned)r.meanCycles, (unsigned)r.baselineCycles,
+                r.baselineCycles == 0 ? "  NO BASELINE" : r.regressed ? "  REGRESSED" : "");
+        }
+
+    return pass;
+}
+
+// Returns the end of the JSON object starting at open
+static const char* jsonObjectEnd(const char* open) {
+    int depth = 0;
+    for (const char* c = open; *c; c++) {
+        if (*c == '{') depth++;
+        else if (*c == '}' && --depth == 0) return c;
+    }
+    return open;
+}
+
+// Finds "key": in [begin, end) and reads its number
+static bool jsonNumber(const char* begin, const char* end, const char* key, uint32_t& value) {
+    char quoted[40];
+    snprintf(quoted, sizeof(quoted), "\"%s\":", key);
+    const char* found = strstr(begin, quoted);
+    if (!found || found >= end) return false;
+    value = strtoul(found + strlen(quoted), nullptr, 10);
+    return true;
+}
+
+const char* BenchClass::defaultBaseline() {
+#ifdef ESP32
+    return benchBaselineStart;
+#else
+    return nullptr;
+#endif
+}
+
+void BenchClass::setBaseline(const char* json) {
+    baselineJson = json;
+}
+
+void BenchClass::loadBaseline() {
+    if (!baselineJson) return; // No baseline given
+
+    // Section of this platform
+        const char* section = strstr(baselineJson, "\"" BENCH_PLATFORM "\"");
+        if (!section || !(section = strchr(section, '{'))) {
+            printf(" - No %s section in the benchmark baseline\n", BENCH_PLATFORM);
+            return;
+        }
+        const char* sectionEnd = jsonObjectEnd(section);
+        jsonNumber(section, sectionEnd, "tolerancePercent", tolerancePercent);
+
+    // Fastest iterations
+        const char* cycles = strstr(section, "\"minCycles\"");
+        if (!cycles || cycles >= sectionEnd || !(cycles = strchr(cycles, '{'))) return;
+        const char* cyclesEnd = jsonObjectEnd(cycles);
+        for (BenchResult& r : results) {
+            jsonNumber(cycles, cyclesEnd, r.name, r.baselineCycles);
+        }
+}
+
+void BenchClass::exportJson(Print& out) {
+    uint32_t cyclesPerUs = getCpuFrequencyMhz();
+    bool pass = true;
+    for (const BenchResult& r : results) {
+        if (r.regressed) pass = false;
+    }
+
+    out.printf("{\"cpuMhz\":%u,\"tolerancePercent\":%u,\"pass\":%s,\"benchmarks\":[",
+        (unsigned)cyclesPerUs, (unsigned)tolerancePercent, pass ? "true" : "false");
+    for (int i = 0; i < BENCH_COUNT; i++) {
+        const BenchResult& r = results[i];
+        out.printf("%s{\"name\":\"%s\",\"iterations\":%u,\"minCycles\":%u,\"meanCycles\":%u,\"minUs\":%.2f,\"baselineCycles\":%u,\"bytes\":%u,\"regressed\":%s}",
+            i == 0 ? "" : ",", r.name, (unsigned)r.iterations, (unsigned)r.minCycles, (unsigned)r.meanCycles,
+            (float)r.minCycles / cyclesPerUs, (unsigned)r.baselineCycles, (unsigned)r.bytes, r.regressed ? "true" : "false");
+    }
+    out.print("]}");
+}
+
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+#include <Print.h>
+#include "sleep_system.hpp"
+#include "server.hpp"
+// This module runs microbenchmarks of the firmware's hot paths on the device.
+//  - Only built with -DBENCH_ENABLED (envs esp32_bench and native). The production firmware has no benchmarks,
+//    no /bench route and no embedded baseline.
+//  - Timing uses the CPU cycle counter, iterations that migrated to the other core are discarded.
+//  - The same suite runs on the device (GET /bench, pio test -e esp32_bench) and on the host (pio test -e native),
+//    on the host the "cycles" are nanoseconds of the shim's cycle counter.
+//  - Results are compared against the checked-in baseline test/bench_baseline.json, which holds one section per
+//    platform ("esp32", "native") with its tolerance and the fastest iteration of each benchmark.
+//    On the device the file is embedded in the firmware, the native test passes it with setBaseline().
+//    A benchmark regresses if its fastest iteration is more than tolerancePercent slower than the baseline.
+//  - GET /bench runs the suite and answers 500 on a regression or a benchmark without a baseline, the test run fails.
+//    To record a new baseline, copy the minCycles of the results into the JSON. The esp32 section has none yet,
+//    the device run fails until one is recorded from a device.
+// Table of benchmarks:
+//  - nextWakeup: Schedule scan for the next deep sleep wakeup (mktime per entry), fixed schedule of 8 doses and fixed time.
+//  - inputJson: /input JSON serialization.
+//  - stateDispatch: /state/... route dispatch, all 7 routes per iteration.
+//  - rootPage: Loading index.html from LittleFS.
+//  - outputPattern: One step of the output pattern (NOTIFICATION_PHASE_4, 10 ms apart).
+//  - logCbor / logJson: Encoding a page of 64 dose log entries, CBOR against JSON (bytes reports the page size).
+
+#ifdef BENCH_ENABLED
+
+#define BENCH_COUNT 7
+
+struct BenchResult {
+    const char* name;
+    uint32_t iterations;      // Iterations measured (without the ones that changed core)
+    uint32_t minCycles;       // Fastest iteration
+    uint32_t meanCycles;      // Average iteration
+    uint32_t baselineCycles;  // Fastest iteration of the baseline, 0 if none recorded
+    uint32_t bytes;           // Output size of one iteration, for the encoding benchmarks
+    bool regressed;           // Slower than the baseline allows, or no baseline
+};
+
+class BenchClass {
+public:
+    // Constructor
+        BenchClass(ServerClass& p_server) : server(p_server) { setBaseline(defaultBaseline()); }
+
+    // Methods
+        bool run();           // Runs all benchmarks, returns false if any regressed or has no baseline
+        void setBaseline(const char* json); // Uses another baseline JSON (kept by the caller), for the native test
+        void exportJson(Print& out); // Writes the last results as JSON
+
+private:
+    // Methods
+        template<typename Body> void measure(BenchResult& result, const char* name, uint32_t iterations, Body body);
+        void loadBaseline();
+        static const char* defaultBaseline();
+
+    // Attributes
+        BenchResult results[BENCH_COUNT] = {};
+        const char* baselineJson;
+        uint32_t tolerancePercent = 25;
+
+    // References to other modules
+        ServerClass& server;
+};
+
+#endif
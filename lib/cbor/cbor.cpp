@@ -0,0 +1,155 @@
+#include "cbor.hpp"
+#include <string.h>
+
+// Major types
+#define CBOR_UINT   0
+#define CBOR_NEGINT 1
+#define CBOR_TEXT   3
+#define CBOR_ARRAY  4
+#define CBOR_MAP    5
+#define CBOR_SIMPLE 7
+
+// Additional information values
+#define CBOR_FALSE      20
+#define CBOR_TRUE       21
+#define CBOR_NULL       22
+#define CBOR_INDEFINITE 31
+#define CBOR_BREAK      0xFF
+
+void CborWriter::beginArray(uint32_t count) {
+    writeHead(CBOR_ARRAY, count);
+}
+
+void CborWriter::beginIndefiniteArray() {
+    out.write((uint8_t)(CBOR_ARRAY << 5 | CBOR_INDEFINITE));
+}
+
+void CborWriter::beginMap(uint32_t pairs) {
+    writeHead(CBOR_MAP, pairs);
+}
+
+void CborWriter::end() {
+    out.write((uint8_t)CBOR_BREAK);
+}
+
+void CborWriter::writeUint(uint64_t value) {
+    writeHead(CBOR_UINT, value);
+}
+
+void CborWriter::writeInt(int64_t value) {
+    if (value < 0) writeHead(CBOR_NEGINT, (uint64_t)(-1 - value));
+    else writeHead(CBOR_UINT, value);
+}
+
+void CborWriter::writeBool(bool value) {
+    out.write((uint8_t)(CBOR_SIMPLE << 5 | (value ? CBOR_TRUE : CBOR_FALSE)));
+}
+
+void CborWriter::writeNull() {
+    out.write((uint8_t)(CBOR_SIMPLE << 5 | CBOR_NULL));
+}
+
+void CborWriter::writeString(const char* value) {
+    size_t len = strlen(value);
+    writeHead(CBOR_TEXT, len);
+    out.write((const uint8_t*)value, len);
+}
+
+void CborWriter::writeHead(uint8_t major, uint64_t value) {
+    // Shortest encoding: inline below 24, then 1, 2, 4 or 8 big endian bytes
+    uint8_t head[9];
+    uint8_t size;
+    if (value < 24) {
+        head[0] = major << 5 | value;
+        size = 1;
+    } else if (value <= 0xFF) {
+        head[0] = major << 5 | 24;
+        size = 2;
+    } else if (value <= 0xFFFF) {
+        head[0] = major << 5 | 25;
+        size = 3;
+    } else if (value <= 0xFFFFFFFF) {
+        head[0] = major << 5 | 26;
+        size = 5;
+    } else {
+        head[0] = major << 5 | 27;
+        size = 9;
+    }
+    for (uint8_t i = 1; i < size; i++) {
+        head[i] = value >> (8 * (size - 1 - i));
+    }
+    out.write(head, size);
+}
+
+bool CborReader::readArray(uint32_t& count) {
+    uint8_t major;
+    uint64_t value;
+    if (!readHead(major, value) || major != CBOR_ARRAY || value > UINT32_MAX) {
+        failed = true;
+        return false;
+    }
+    count = value;
+    return true;
+}
+
+bool CborReader::readMap(uint32_t& pairs) {
+    uint8_t major;
+    uint64_t value;
+    if (!readHead(major, value) || major != CBOR_MAP || value > UINT32_MAX) {
+        failed = true;
+        return false;
+    }
+    pairs = value;
+    return true;
+}
+
+bool CborReader::readUint(uint32_t& value) {
+    uint8_t major;
+    uint64_t raw;
+    if (!readHead(major, raw) || major != CBOR_UINT || raw > UINT32_MAX) {
+        failed = true;
+        return false;
+    }
+    value = raw;
+    return true;
+}
+
+bool CborReader::readString(char* buffer, size_t size) {
+    uint8_t major;
+    uint64_t len;
+    if (!readHead(major, len) || major != CBOR_TEXT || len >= size || len > length - position) {
+        failed = true;
+        return false;
+    }
+    memcpy(buffer, data + position, len);
+    buffer[len] = '\0';
+    position += len;
+    return true;
+}
+
+bool CborReader::readHead(uint8_t& major, uint64_t& value) {
+    if (failed || position >= length) {
+        failed = true;
+        return false;
+    }
+
+    uint8_t initial = data[position++];
+    major = initial >> 5;
+    uint8_t info = initial & 0x1F;
+
+    if (info < 24) {
+        value = info;
+        return true;
+    }
+    // Indefinite lengths and reserved values are not supported here
+    uint8_t size = 1 << (info - 24);
+    if (info > 27 || length - position < size) {
+        failed = true;
+        return false;
+    }
+    value = 0;
+    for (uint8_t i = 0; i < size; i++) {
+        value = value << 8 | data[position++];
+    }
+    return true;
+}
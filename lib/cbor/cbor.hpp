@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <Print.h>
+// Minimal streaming CBOR (RFC 8949) encoder and decoder for the bulk transfer API.
+//  - CborWriter writes every item straight to a Print, nothing is buffered.
+//  - CborReader pulls items from a fixed buffer, it never allocates.
+// Only what the API needs is supported: unsigned / negative integers, text strings, arrays, maps, booleans and null.
+
+#define CBOR_CONTENT_TYPE "application/cbor"
+
+class CborWriter {
+public:
+    // Constructor
+        CborWriter(Print& p_out) : out(p_out) {}
+
+    // Methods
+        void beginArray(uint32_t count);
+        void beginIndefiniteArray(); // Closed with end(), for streams of unknown length
+        void beginMap(uint32_t pairs);
+        void end();                  // Closes an indefinite length item
+        void writeUint(uint64_t value);
+        void writeInt(int64_t value);
+        void writeBool(bool value);
+        void writeNull();
+        void writeString(const char* value);
+
+private:
+    // Methods
+        void writeHead(uint8_t major, uint64_t value);
+
+    // Attributes
+        Print& out;
+};
+
+class CborReader {
+public:
+    // Constructor
+        CborReader(const uint8_t* p_data, size_t p_length) : data(p_data), length(p_length) {}
+
+    // Methods
+        bool readArray(uint32_t& count); // Definite length arrays only
+        bool readMap(uint32_t& pairs);   // Definite length maps only
+        bool readUint(uint32_t& value);
+        bool readString(char* buffer, size_t size); // Fails if the string does not fit (including the terminator)
+        bool atEnd() { return position >= length; }
+        bool ok() { return !failed; }
+
+private:
+    // Methods
+        bool readHead(uint8_t& major, uint64_t& value);
+
+    // Attributes
+        const uint8_t* data;
+        size_t length;
+        size_t position = 0;
+        bool failed = false;
+};
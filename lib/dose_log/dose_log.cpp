@@ -0,0 +1,120 @@
+#include "dose_log.hpp"
+#include <LittleFS.h>
+
+#define DOSE_LOG_PATH "/doses.log"
+#define DOSE_LOG_TEMP_PATH "/doses.tmp"
+#define DOSE_LOG_MAGIC 0x31474C44 // "DLG1"
+
+struct DoseLogHeader {
+    uint32_t magic;
+    uint32_t firstSequence;
+};
+
+void DoseLogClass::begin() {
+    mutex = xSemaphoreCreateMutex();
+    compactAt = DOSE_LOG_CAPACITY;
+
+    // Read the header, start a new log if there is none (or it is not ours)
+        File file = LittleFS.open(DOSE_LOG_PATH, "r");
+        DoseLogHeader header = {0, 0};
+        if (file) {
+            if (file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) && header.magic == DOSE_LOG_MAGIC) {
+                first = header.firstSequence;
+                count = (file.size() - sizeof(header)) / sizeof(DoseLogEntry);
+            }
+            file.close();
+        }
+
+        if (header.magic != DOSE_LOG_MAGIC) {
+            header = {DOSE_LOG_MAGIC, 0};
+            file = LittleFS.open(DOSE_LOG_PATH, "w");
+            file.write((const uint8_t*)&header, sizeof(header));
+            file.close();
+            first = 0;
+            count = 0;
+        }
+
+    printf("Dose log: %u entries (sequence %u to %u)\n", (unsigned)count, (unsigned)first, (unsigned)(first + count));
+}
+
+void DoseLogClass::append(DoseEvent event, uint8_t compartment) {
+    time_t now;
+    time(&now);
+    DoseLogEntry entry = {(uint32_t)now, (uint8_t)event, compartment, 0};
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+        if (count >= compactAt) {
+            compactAt = dropOldestHalf() ? DOSE_LOG_CAPACITY : count + DOSE_LOG_COMPACT_RETRY;
+        }
+
+        File file = LittleFS.open(DOSE_LOG_PATH, "a");
+        if (file) {
+            if (file.write((const uint8_t*)&entry, sizeof(entry)) == sizeof(entry)) count++;
+            file.close();
+        }
+    xSemaphoreGive(mutex);
+}
+
+uint32_t DoseLogClass::firstSequence() {
+    return first;
+}
+
+uint32_t DoseLogClass::nextSequence() {
+    return first + count;
+}
+
+uint32_t DoseLogClass::read(uint32_t from, DoseLogEntry* entries, uint32_t maxCount) {
+    uint32_t readCount = 0;
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+        if (from < first) from = first; // Already dropped, continue with the oldest we have
+        if (from < first + count) {
+            uint32_t available = first + count - from;
+            uint32_t wanted = maxCount < available ? maxCount : available;
+
+            File file = LittleFS.open(DOSE_LOG_PATH, "r");
+            if (file && file.seek(sizeof(DoseLogHeader) + (from - first) * sizeof(DoseLogEntry))) {
+                readCount = file.read((uint8_t*)entries, wanted * sizeof(DoseLogEntry)) / sizeof(DoseLogEntry);
+            }
+            if (file) file.close();
+        }
+    xSemaphoreGive(mutex);
+
+    return readCount;
+}
+
+bool DoseLogClass::dropOldestHalf() {
+    // Copy the newer half into a new file, in small blocks to keep the stack usage low
+        uint32_t drop = count / 2;
+        DoseLogHeader header = {DOSE_LOG_MAGIC, first + drop};
+
+        File source = LittleFS.open(DOSE_LOG_PATH, "r");
+        File target = LittleFS.open(DOSE_LOG_TEMP_PATH, "w");
+        if (!source || !target) {
+            if (source) source.close();
+            if (target) target.close();
+            printf("Dose log: compaction failed, can't open the files\n");
+            return false;
+        }
+
+        bool complete = target.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+        source.seek(sizeof(DoseLogHeader) + drop * sizeof(DoseLogEntry));
+
+        uint8_t block[16 * sizeof(DoseLogEntry)];
+        int length;
+        while (complete && (length = source.read(block, sizeof(block))) > 0) {
+            complete = target.write(block, length) == (size_t)length;
+        }
+        source.close();
+        target.close();
+
+    // Replace the log in one step, rename overwrites (a remove first would lose the log on a power failure in between)
+        if (!complete || !LittleFS.rename(DOSE_LOG_TEMP_PATH, DOSE_LOG_PATH)) {
+            LittleFS.remove(DOSE_LOG_TEMP_PATH);
+            printf("Dose log: compaction failed, keeping the full log\n");
+            return false;
+        }
+        first += drop;
+        count -= drop;
+        return true;
+}
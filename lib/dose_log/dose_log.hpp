@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+#include <Arduino.h>
+// This module keeps the dose history in LittleFS (/doses.log).
+//  - Fixed size 8 byte records after a small header, so any entry can be read by its index without parsing.
+//  - Entries are addressed by an absolute sequence number, which stays valid when old entries are dropped.
+//    This lets a download resume from the last sequence number it received.
+//  - Once DOSE_LOG_CAPACITY entries are stored the oldest half is dropped. The newer half is copied to a temporary
+//    file that is renamed over the log, a power failure leaves either the old or the compacted log.
+//    A failed compaction (flash full) is retried after DOSE_LOG_COMPACT_RETRY more entries, not on every append.
+
+#define DOSE_LOG_CAPACITY 16384     // About two years at 20 entries a day, 128 kB of flash
+#define DOSE_LOG_NO_COMPARTMENT 0xFF // Main hatch / single hatch mode
+#define DOSE_LOG_COMPACT_RETRY 64    // Entries appended before a failed compaction is tried again
+
+enum class DoseEvent : uint8_t {
+    DUE,          // A scheduled dose came due (timer wakeup)
+    TAKEN,        // A compartment with a due dose was opened
+    HATCH_OPENED  // The main hatch was opened
+};
+
+struct DoseLogEntry {
+    uint32_t time;       // Unix time (seconds)
+    uint8_t event;       // DoseEvent
+    uint8_t compartment; // Compartment id or DOSE_LOG_NO_COMPARTMENT
+    uint16_t reserved;
+};
+
+class DoseLogClass {
+public:
+    // Methods
+        void begin(); // Opens (or creates) the log, LittleFS must be mounted
+        void append(DoseEvent event, uint8_t compartment = DOSE_LOG_NO_COMPARTMENT);
+        uint32_t firstSequence(); // Sequence number of the oldest stored entry
+        uint32_t nextSequence();  // Sequence number the next entry will get
+        uint32_t read(uint32_t from, DoseLogEntry* entries, uint32_t maxCount); // Reads up to maxCount entries starting at sequence from, returns how many
+
+private:
+    // Methods
+        bool dropOldestHalf(); // False if the log could not be rewritten (it is left unchanged)
+
+    // Attributes
+        uint32_t first = 0; // Sequence number of the first stored entry
+        uint32_t count = 0; // Stored entries
+        uint32_t compactAt = DOSE_LOG_CAPACITY; // Stored entries that trigger the next compaction
+        SemaphoreHandle_t mutex = NULL;
+};
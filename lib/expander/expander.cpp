@@ -0,0 +1,130 @@
+#include "expander.hpp"
+#include <Wire.h>
+#include <esp_timer.h>
+#include <pinout.hpp>
+
+// I2C configuration
+#define I2C_FREQUENCY 400000
+
+// MCP23017 registers (IOCON.BANK = 0, ports A and B interleaved)
+#define REG_IODIRA   0x00
+#define REG_GPINTENA 0x04
+#define REG_INTCONA  0x08
+#define REG_IOCON    0x0A
+#define REG_GPPUA    0x0C
+#define REG_GPIOA    0x12
+
+#define IOCON_MIRROR 0x40 // INTA and INTB are internally connected
+#define IOCON_ODR    0x04 // Open drain interrupt output (allows wired OR of several chips)
+
+TaskHandle_t ExpanderClass::notifyTask = NULL;
+WireExpanderBus wireExpanderBus;
+
+uint8_t ExpanderClass::begin() {
+    printf(" - Probing I/O expanders...\n");
+    bus.begin();
+
+    // Count the expanders answering in a row
+        expanders = 0;
+        while (expanders < MAX_EXPANDERS && bus.probe(EXPANDER_BASE_ADDRESS + expanders)) {
+            expanders++;
+        }
+        compartments = expanders * EXPANDER_PINS;
+        if (compartments > MAX_COMPARTMENTS) compartments = MAX_COMPARTMENTS;
+
+        if (expanders == 0) {
+            printf(" - No I/O expanders found, single hatch mode\n");
+            return 0;
+        }
+
+    // Configure every expander: all inputs with pullups, interrupt on change of the used pins
+        for (uint8_t e = 0; e < expanders; e++) {
+            uint8_t address = EXPANDER_BASE_ADDRESS + e;
+            uint8_t used = compartments - e * EXPANDER_PINS;
+            uint16_t mask = used >= EXPANDER_PINS ? 0xFFFF : (1 << used) - 1;
+
+            const uint8_t iocon[] = {IOCON_MIRROR | IOCON_ODR};
+            const uint8_t inputs[] = {0xFF, 0xFF};
+            const uint8_t pullups[] = {0xFF, 0xFF};
+            const uint8_t compareToPrevious[] = {0x00, 0x00};
+            const uint8_t interrupts[] = {(uint8_t)(mask & 0xFF), (uint8_t)(mask >> 8)};
+
+            bus.writeRegisters(address, REG_IOCON, iocon, sizeof(iocon));
+            bus.writeRegisters(address, REG_IODIRA, inputs, sizeof(inputs));
+            bus.writeRegisters(address, REG_GPPUA, pullups, sizeof(pullups));
+            bus.writeRegisters(address, REG_INTCONA, compareToPrevious, sizeof(compareToPrevious));
+            bus.writeRegisters(address, REG_GPINTENA, interrupts, sizeof(interrupts));
+        }
+
+    pinMode(PIN_EXPANDER_INT, INPUT_PULLUP);
+    scan(); // Clears any pending interrupt
+
+    printf(" - %d I/O expanders, %d compartments\n", expanders, compartments);
+    return compartments;
+}
+
+void ExpanderClass::attach(TaskHandle_t task) {
+    if (compartments == 0) return;
+
+    notifyTask = task;
+    attachInterrupt(digitalPinToInterrupt(PIN_EXPANDER_INT), onInterrupt, FALLING);
+}
+
+uint32_t ExpanderClass::scan() {
+    int64_t start = esp_timer_get_time();
+    uint32_t open = 0;
+
+    for (uint8_t e = 0; e < expanders; e++) {
+        uint8_t address = EXPANDER_BASE_ADDRESS + e;
+
+        // GPIOA and GPIOB in one read (sequential addressing), reading them clears the interrupt
+        uint8_t gpio[2];
+        if (!bus.readRegisters(address, REG_GPIOA, gpio, sizeof(gpio))) continue;
+
+        uint16_t ports = gpio[0] | gpio[1] << 8;
+        open |= (uint32_t)ports << (e * EXPANDER_PINS); // High = open, the pullup wins when the reed switch opens
+    }
+
+    if (compartments < 32) open &= (1UL << compartments) - 1;
+
+    lastScanUs = esp_timer_get_time() - start;
+    if (lastScanUs > maxScanUs) maxScanUs = lastScanUs;
+    return open;
+}
+
+void IRAM_ATTR ExpanderClass::onInterrupt() {
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(notifyTask, &higherPriorityTaskWoken);
+    if (higherPriorityTaskWoken) portYIELD_FROM_ISR();
+}
+
+void WireExpanderBus::begin() {
+    Wire.begin(PIN_I2C_SDA, PIN_I2C_SCL, I2C_FREQUENCY);
+}
+
+bool WireExpanderBus::probe(uint8_t address) {
+    Wire.beginTransmission(address);
+    return Wire.endTransmission() == 0;
+}
+
+bool WireExpanderBus::writeRegisters(uint8_t address, uint8_t reg, const uint8_t* values, uint8_t length) {
+    Wire.beginTransmission(address);
+    Wire.write(reg);
+    for (uint8_t i = 0; i < length; i++) {
+        Wire.write(values[i]);
+    }
+    return Wire.endTransmission() == 0;
+}
+
+bool WireExpanderBus::readRegisters(uint8_t address, uint8_t reg, uint8_t* values, uint8_t length) {
+    // Register address, then a repeated start for the read
+    Wire.beginTransmission(address);
+    Wire.write(reg);
+    if (Wire.endTransmission(false) != 0) return false;
+    if (Wire.requestFrom(address, length) != length) return false;
+
+    for (uint8_t i = 0; i < length; i++) {
+        values[i] = Wire.read();
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+#include <Arduino.h>
+// This module reads the compartment hatch sensors through MCP23017 I2C GPIO expanders.
+//  - Compartment N is pin N % 16 (A0..A7, B0..B7) of the expander at EXPANDER_BASE_ADDRESS + N / 16.
+//  - All expanders mirror INTA/INTB as open drain outputs wired together on PIN_EXPANDER_INT,
+//    so a single interrupt wakes the input task for any compartment.
+//  - A scan reads both ports of each expander in one I2C transaction (which also clears the interrupt).
+// Expanders that do not answer at startup are skipped, without any the device runs in single hatch mode.
+// Register access goes through an ExpanderBus (Wire on the device), tests drive a fake MCP23017 through it.
+
+#ifndef MAX_COMPARTMENTS
+#define MAX_COMPARTMENTS 28 // Weekly organizer, 4 doses a day
+#endif
+
+#define EXPANDER_BASE_ADDRESS 0x20
+#define EXPANDER_PINS 16
+#define MAX_EXPANDERS ((MAX_COMPARTMENTS + EXPANDER_PINS - 1) / EXPANDER_PINS)
+
+// Register access of the MCP23017s (sequential addressing, IOCON.BANK = 0)
+class ExpanderBus {
+public:
+    virtual void begin() {}
+    virtual bool probe(uint8_t address) = 0; // True if a chip acknowledges the address
+    virtual bool writeRegisters(uint8_t address, uint8_t reg, const uint8_t* values, uint8_t length) = 0;
+    virtual bool readRegisters(uint8_t address, uint8_t reg, uint8_t* values, uint8_t length) = 0;
+};
+
+// ExpanderBus over the I2C peripheral
+class WireExpanderBus : public ExpanderBus {
+public:
+    void begin() override;
+    bool probe(uint8_t address) override;
+    bool writeRegisters(uint8_t address, uint8_t reg, const uint8_t* values, uint8_t length) override;
+    bool readRegisters(uint8_t address, uint8_t reg, uint8_t* values, uint8_t length) override;
+};
+extern WireExpanderBus wireExpanderBus;
+
+class ExpanderClass {
+public:
+    // Constructor
+        ExpanderClass(ExpanderBus& p_bus = wireExpanderBus) : bus(p_bus) {}
+
+    // Methods
+        uint8_t begin();                 // Probes and configures the expanders, returns the number of compartments
+        void attach(TaskHandle_t task);  // Notifies the task whenever the shared interrupt line fires
+        uint32_t scan();                 // Reads all expanders in a batch, returns the bitmask of open compartments
+        uint8_t count() { return compartments; }
+
+    // Attributes
+        uint32_t lastScanUs = 0; // Duration of the last scan
+        uint32_t maxScanUs = 0;  // Longest scan so far
+
+private:
+    // Methods
+        static void IRAM_ATTR onInterrupt(); // Shared interrupt line ISR
+
+    // Attributes
+        uint8_t compartments = 0;
+        uint8_t expanders = 0;
+        static TaskHandle_t notifyTask;
+
+    // References to other modules
+        ExpanderBus& bus;
+};
@@ -2,6 +2,13 @@
 #include <Arduino.h>
 #include "input.hpp"
 #include "pinout.hpp"
+#include <trace.hpp>
+#include <power.hpp>
+#include <output.hpp>
+
+extern TraceClass trace;
+extern PowerClass power;
+extern OuptutClass output;
 
 void InputClass::begin() {
     printf("Initializing input module...\n");
@@ -11,15 +18,20 @@ void InputClass::begin() {
         pinMode(PIN_USER_BUTTON, INPUT);
         pinMode(PIN_BATTERY_VOLTAGE, INPUT);
 
+    // Initialize compartment I/O expanders
+        data.compartmentCount = expander.begin();
+
     // Create FreeRTOS task for handling input
+    TaskHandle_t taskHandle = NULL;
     xTaskCreate(
         inputTask,       // Task function
         "InputTask",     // Task name
         4096,            // Stack size (bytes)
         this,            // Parameter to pass to task
         1,               // Priority (1 = low)
-        NULL             // Task handle
+        &taskHandle      // Task handle
     );
+    expander.attach(taskHandle);
     printf(" - Input task created!\n");
 }
 
@@ -29,15 +41,49 @@ void InputClass::inputTask(void* parameter) {
 
     while (true) {
         // Read hatch switch state
-        input->data.isHatchOpen = digitalRead(PIN_HATCH_BUTTON);
+        bool isHatchOpen = digitalRead(PIN_HATCH_BUTTON);
+        if (isHatchOpen != input->data.isHatchOpen) {
+            trace.record(TraceTask::INPUT_TASK, TraceEvent::HATCH_EDGE, isHatchOpen);
+            output.setHatchOpen(isHatchOpen); // Starts HATCH_TO_OUTPUT if the output will react
+        }
+        input->data.isHatchOpen = isHatchOpen;
 
         // Read user button state
-        input->data.isUserSwitchPressed = digitalRead(PIN_USER_BUTTON);
+        bool isUserSwitchPressed = digitalRead(PIN_USER_BUTTON);
+        if (isUserSwitchPressed != input->data.isUserSwitchPressed) {
+            trace.record(TraceTask::INPUT_TASK, TraceEvent::USER_SWITCH_EDGE, isUserSwitchPressed);
+        }
+        input->data.isUserSwitchPressed = isUserSwitchPressed;
+
+        // Read compartment hatches
+        if (input->data.compartmentCount > 0) {
+            uint32_t openCompartments = input->expander.scan();
+            uint32_t changed = openCompartments ^ input->data.openCompartments;
+            for (uint8_t i = 0; changed != 0; i++, changed >>= 1) {
+                if (changed & 1) {
+                    trace.record(TraceTask::INPUT_TASK, TraceEvent::COMPARTMENT_EDGE, (i << 1) | ((openCompartments >> i) & 1));
+                }
+            }
+            if (openCompartments != input->data.openCompartments) {
+                output.setOpenCompartments(openCompartments); // Starts HATCH_TO_OUTPUT if the output will react
+            }
+            input->data.openCompartments = openCompartments;
+
+            // Another edge came in during the scan, the line stays low without a new falling edge
+            if (digitalRead(PIN_EXPANDER_INT) == LOW) {
+                xTaskNotifyGive(xTaskGetCurrentTaskHandle());
+            }
+        }
 
         // Read battery voltage
-        int rawValue = analogRead(PIN_BATTERY_VOLTAGE);
-        input->data.batteryVoltage = (rawValue / 4095.0f) * 3.3f * 2.0f;
+        input->data.batteryVoltage = readBatteryVoltage();
 
-        vTaskDelay(100 / portTICK_PERIOD_MS); // Read inputs every 100ms
+        // Wait for the next sample (rate depends on the power tier) or an expander interrupt
+        ulTaskNotifyTake(pdTRUE, power.policy().inputIntervalMs / portTICK_PERIOD_MS);
     }
+}
+
+float InputClass::readBatteryVoltage() {
+    int rawValue = analogRead(PIN_BATTERY_VOLTAGE);
+    return (rawValue / 4095.0f) * 3.3f * 2.0f;
 }
\ No newline at end of file
@@ -1,20 +1,26 @@
 #pragma once
+#include "expander.hpp"
 // This module handles interupts every time either of the switches changes state. It also periodicaly reads the battery voltage.
+// Compartment hatches are read through the I/O expanders, the task wakes right away on their shared interrupt.
 // The data is provided to other modules through a public struct
 
 struct InputData {
-    bool isHatchOpen;         // True if hatch is open, false if closed
-    bool isUserSwitchPressed; // True if the user button is pressed
-    float batteryVoltage;     // Current battery voltage in volts
+    bool isHatchOpen;          // True if hatch is open, false if closed
+    bool isUserSwitchPressed;  // True if the user button is pressed
+    float batteryVoltage;      // Current battery voltage in volts
+    uint32_t openCompartments; // Bit N is set while compartment N is open
+    uint8_t compartmentCount;  // Number of compartments (0 without I/O expanders)
 };
 
 class InputClass {
 public:
     // Methods
         void begin(); // Initializes the output module
+        static float readBatteryVoltage(); // Samples the battery voltage once
 
     // Attributes
-        InputData data; // Current input data
+        InputData data;         // Current input data
+        ExpanderClass expander; // Compartment hatch sensors
 
 private:
     // Methods
@@ -0,0 +1,268 @@
+#include "journal.hpp"
+#include <Arduino.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <LittleFS.h>
+#include <stddef.h>
+
+#define JOURNAL_MAGIC 0x314C524A       // "JRL1", marks the RTC journal and the flash checkpoint as ours
+#define JOURNAL_FAULT_MAGIC 0x31544C46 // "FLT1", an injected fault waits to be checked
+#define JOURNAL_CHECKPOINT_PATH "/journal.bin"
+
+// Keeps the compiler from moving stores across it, the order of the RTC writes is what makes them crash safe
+#define JOURNAL_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+struct JournalCheckpoint {
+    uint32_t magic;
+    JournalState state;
+    uint32_t checksum;
+};
+
+// Journal in RTC memory (not cleared on deep sleep or software reset)
+RTC_NOINIT_ATTR JournalStorage rtcJournalStorage;
+
+#ifdef JOURNAL_FAULT_INJECTION
+    // Stops writing at the armed write point and resets, like a brownout would
+    #define JOURNAL_FAULT_POINT(expected) if (faultPoint(expected)) { portEXIT_CRITICAL(&journalMux); esp_restart(); }
+#else
+    #define JOURNAL_FAULT_POINT(expected)
+#endif
+
+static portMUX_TYPE journalMux = portMUX_INITIALIZER_UNLOCKED;
+static const char* sourceNames[] = {"none", "rtc", "flash"};
+
+static uint32_t checksum(const void* data, size_t length) {
+    // FNV-1a
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t baseChecksum(const JournalBase& base) {
+    return checksum(&base, offsetof(JournalBase, checksum));
+}
+
+static uint32_t recordHeader(uint32_t sequence, JournalField field, uint32_t value) {
+    uint32_t header = (sequence & 0xFFFF) | (uint32_t)field << 16;
+    uint32_t check = checksum(&value, sizeof(value)) ^ checksum(&header, sizeof(header));
+    return header | (check & 0xFF) << 24;
+}
+
+static uint32_t fieldValue(const JournalState& state, JournalField field) {
+    switch (field) {
+        case JournalField::OUTPUT_STATE: return state.outputState;
+        case JournalField::DUE_COMPARTMENTS: return state.dueCompartments;
+        case JournalField::SLEEP_COUNTER: return state.sleepCounter;
+    }
+    return 0;
+}
+
+static void applyField(JournalState& state, JournalField field, uint32_t value) {
+    switch (field) {
+        case JournalField::OUTPUT_STATE: state.outputState = value; break;
+        case JournalField::DUE_COMPARTMENTS: state.dueCompartments = value; break;
+        case JournalField::SLEEP_COUNTER: state.sleepCounter = value; break;
+    }
+}
+
+void JournalClass::begin() {
+    esp_reset_reason_t reason = esp_reset_reason();
+    current = {};
+    recoveredFrom = JournalSource::NONE;
+
+    // Load the flash checkpoint, it is the fallback and tells what is already durable
+        JournalCheckpoint stored;
+        bool flashValid = false;
+        File file = LittleFS.open(JOURNAL_CHECKPOINT_PATH, "r");
+        if (file) {
+            flashValid = file.read((uint8_t*)&stored, sizeof(stored)) == sizeof(stored) && stored.magic == JOURNAL_MAGIC &&
+                stored.checksum == checksum(&stored, offsetof(JournalCheckpoint, checksum));
+            file.close();
+        }
+        if (flashValid) checkpointed = stored.state;
+
+    // Recover the state (RTC memory contains garbage after power on)
+        if (reason != ESP_RST_POWERON && storage->magic == JOURNAL_MAGIC && replay()) {
+            recoveredFrom = JournalSource::RTC;
+        } else if (flashValid) {
+            current = stored.state;
+            recoveredFrom = JournalSource::FLASH;
+        }
+
+    #ifdef JOURNAL_FAULT_INJECTION
+        if (storage->faultMagic == JOURNAL_FAULT_MAGIC) {
+            storage->faultMagic = 0;
+            faultCheck = memcmp(&current, &storage->faultExpected, sizeof(JournalState)) == 0 ? "pass" : "fail";
+            printf("Journal: injected fault check %s\n", faultCheck);
+        }
+    #endif
+
+    // A deep sleep wakeup starts a new awake period
+        if (reason == ESP_RST_DEEPSLEEP) {
+            current.sleepCounter = 0;
+        }
+
+    // Start over in RTC memory if there was no valid journal there
+        portENTER_CRITICAL(&journalMux);
+            if (recoveredFrom != JournalSource::RTC) {
+                for (JournalBase& base : storage->bases) {
+                    base.checksum = baseChecksum(base) ^ 1; // Invalid
+                }
+                memset(storage->records, 0, sizeof(storage->records));
+                lastSequence = 0;
+                activeBase = 1; // compact() fills base 0 first
+                storage->magic = JOURNAL_MAGIC;
+            }
+            compact(); // New base on the recovered state, the journal is empty again
+        portEXIT_CRITICAL(&journalMux);
+
+    printf("Journal: recovered from %s (output state %u, due compartments 0x%x, sleep countdown %u)\n",
+        sourceNames[(int)recoveredFrom], (unsigned)current.outputState, (unsigned)current.dueCompartments, (unsigned)current.sleepCounter);
+}
+
+void JournalClass::record(JournalField field, uint32_t value) {
+    uint32_t start = ESP.getCycleCount();
+
+    portENTER_CRITICAL(&journalMux);
+        if (fieldValue(current, field) == value) {
+            portEXIT_CRITICAL(&journalMux);
+            return; // No transition
+        }
+
+        // The slot of the next record still holds one the active base depends on
+        uint32_t sequence = lastSequence + 1;
+        if (sequence - baseSequence > JOURNAL_RING_SIZE) {
+            compact();
+        }
+
+        JournalState previous = current;
+        applyField(current, field, value);
+
+        // Value first, the header makes the record valid
+        JournalRecord& record = storage->records[sequence % JOURNAL_RING_SIZE];
+        record.value = value;
+        JOURNAL_BARRIER();
+        JOURNAL_FAULT_POINT(previous);
+        record.header = recordHeader(sequence, field, value);
+        JOURNAL_BARRIER();
+        JOURNAL_FAULT_POINT(current);
+        lastSequence = sequence;
+
+        uint32_t cycles = ESP.getCycleCount() - start;
+        writes++;
+        totalWriteCycles += cycles;
+        if (cycles > maxWriteCycles) maxWriteCycles = cycles;
+    portEXIT_CRITICAL(&journalMux);
+}
+
+void JournalClass::checkpoint() {
+    portENTER_CRITICAL(&journalMux);
+        JournalCheckpoint stored = {JOURNAL_MAGIC, current, 0};
+    portEXIT_CRITICAL(&journalMux);
+
+    // The countdown is not durable, it starts over after a power loss anyway
+    stored.state.sleepCounter = 0;
+    if (memcmp(&stored.state, &checkpointed, sizeof(JournalState)) == 0) return;
+    stored.checksum = checksum(&stored, offsetof(JournalCheckpoint, checksum));
+
+    // LittleFS commits the file on close, a reset before that keeps the previous checkpoint
+    int64_t startUs = esp_timer_get_time();
+    File file = LittleFS.open(JOURNAL_CHECKPOINT_PATH, "w");
+    if (!file) {
+        printf("Failed to write the journal checkpoint\n");
+        return;
+    }
+    file.write((const uint8_t*)&stored, sizeof(stored));
+    file.close();
+    lastCheckpointUs = esp_timer_get_time() - startUs;
+
+    checkpointed = stored.state;
+    checkpoints++;
+}
+
+void JournalClass::exportJson(Print& out) {
+    portENTER_CRITICAL(&journalMux);
+        JournalState state = current;
+        uint32_t sequence = lastSequence;
+        uint32_t writeCount = writes;
+        uint64_t writeCycles = totalWriteCycles;
+        uint32_t maxCycles = maxWriteCycles;
+    portEXIT_CRITICAL(&journalMux);
+
+    out.printf("{\"source\":\"%s\",\"sequence\":%u,\"outputState\":%u,\"dueCompartments\":%u,\"sleepCounter\":%u,",
+        sourceNames[(int)recoveredFrom], (unsigned)sequence, (unsigned)state.outputState,
+        (unsigned)state.dueCompartments, (unsigned)state.sleepCounter);
+    out.printf("\"writes\":%u,\"meanWriteCycles\":%u,\"maxWriteCycles\":%u,\"compactions\":%u,\"checkpoints\":%u,\"lastCheckpointUs\":%u",
+        (unsigned)writeCount, (unsigned)(writeCount ? writeCycles / writeCount : 0), (unsigned)maxCycles,
+        (unsigned)compactions, (unsigned)checkpoints, (unsigned)lastCheckpointUs);
+    #ifdef JOURNAL_FAULT_INJECTION
+        out.printf(",\"faultCheck\":\"%s\"", faultCheck);
+    #endif
+    out.print("}");
+}
+
+#ifdef JOURNAL_FAULT_INJECTION
+    void JournalClass::armFault(uint32_t writePoint) {
+        portENTER_CRITICAL(&journalMux);
+            faultCountdown = writePoint;
+        portEXIT_CRITICAL(&journalMux);
+    }
+
+    bool JournalClass::faultPoint(const JournalState& expected) {
+        if (faultCountdown == 0 || --faultCountdown > 0) return false;
+
+        storage->faultExpected = expected;
+        storage->faultMagic = JOURNAL_FAULT_MAGIC;
+        return true;
+    }
+#endif
+
+void JournalClass::compact() {
+    // Overwrite the older base, the active one stays valid until the new checksum is written
+    JournalBase& base = storage->bases[activeBase ^ 1];
+    base.sequence = lastSequence;
+    base.state = current;
+    JOURNAL_BARRIER();
+    JOURNAL_FAULT_POINT(current);
+    base.checksum = baseChecksum(base);
+    JOURNAL_BARRIER();
+
+    activeBase ^= 1;
+    baseSequence = lastSequence;
+    compactions++;
+}
+
+bool JournalClass::replay() {
+    // Newest valid base snapshot
+        bool valid[2];
+        for (int i = 0; i < 2; i++) {
+            valid[i] = storage->bases[i].checksum == baseChecksum(storage->bases[i]);
+        }
+        if (!valid[0] && !valid[1]) return false;
+
+        if (valid[0] && valid[1]) {
+            activeBase = (int32_t)(storage->bases[1].sequence - storage->bases[0].sequence) > 0 ? 1 : 0;
+        } else {
+            activeBase = valid[0] ? 0 : 1;
+        }
+        current = storage->bases[activeBase].state;
+        lastSequence = storage->bases[activeBase].sequence;
+        baseSequence = lastSequence;
+
+    // Apply the records written after it, up to the first incomplete one
+        for (uint32_t i = 0; i < JOURNAL_RING_SIZE; i++) {
+            uint32_t sequence = lastSequence + 1;
+            const JournalRecord& record = storage->records[sequence % JOURNAL_RING_SIZE];
+            uint8_t field = record.header >> 16 & 0xFF;
+            if (field > (uint8_t)JournalField::SLEEP_COUNTER) break;
+            if (record.header != recordHeader(sequence, (JournalField)field, record.value)) break;
+
+            applyField(current, (JournalField)field, record.value);
+            lastSequence = sequence;
+        }
+    return true;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <stdint.h>
+#include <Print.h>
+// This module keeps the alert state across resets (brownout, watchdog, panic) so an alert continues where it was.
+//  - Every transition is appended to a small journal in RTC memory, which costs a few stores and no flash access.
+//    A record becomes valid with its last 32 bit store, a reset in the middle of a write leaves the old state.
+//  - When the journal is full it is folded into one of two base snapshots (the older one is overwritten),
+//    so there is always a complete base to replay the journal on.
+//  - The flash checkpoint (LittleFS) is only written when the durable part of the state changed, it covers power loss.
+//  - On boot the state is recovered from RTC memory, or from the flash checkpoint after a power on.
+// Build with -DJOURNAL_FAULT_INJECTION to be able to reset the device at a chosen write point (/journal?crashAt=N),
+// the next boot checks that the recovered state is the expected one.
+
+#define JOURNAL_RING_SIZE 32 // Records between two base snapshots
+
+enum class JournalField : uint8_t {
+    OUTPUT_STATE,     // OutputState
+    DUE_COMPARTMENTS, // Doses due and not taken yet (bit N = compartment N)
+    SLEEP_COUNTER     // Seconds everything has been closed (sleep countdown)
+};
+
+struct JournalState {
+    uint8_t outputState;
+    uint8_t sleepCounter;
+    uint16_t reserved;
+    uint32_t dueCompartments;
+};
+
+struct JournalBase {
+    uint32_t sequence; // Newest record folded into this snapshot
+    JournalState state;
+    uint32_t checksum; // Written last, the snapshot is valid once it matches
+};
+
+struct JournalRecord {
+    uint32_t value;
+    uint32_t header; // Sequence (low 16 bits), field and check byte, written last
+};
+
+// Memory the journal lives in, RTC memory on the device (rtcJournalStorage), kept across resets but not power loss
+struct JournalStorage {
+    uint32_t magic;
+    JournalBase bases[2];
+    JournalRecord records[JOURNAL_RING_SIZE];
+
+#ifdef JOURNAL_FAULT_INJECTION
+    uint32_t faultMagic;
+    JournalState faultExpected; // State the next boot has to recover
+#endif
+};
+extern JournalStorage rtcJournalStorage;
+
+enum class JournalSource : uint8_t {
+    NONE,  // Nothing stored, default state
+    RTC,   // Replayed from RTC memory
+    FLASH  // Loaded from the flash checkpoint
+};
+
+class JournalClass {
+public:
+    // Methods
+        JournalClass(JournalStorage* p_storage = &rtcJournalStorage) : storage(p_storage) {}
+        void begin(); // Recovers the state, LittleFS must be mounted
+        const JournalState& state() { return current; } // State recovered on boot, updated by record()
+        JournalSource source() { return recoveredFrom; }
+        void record(JournalField field, uint32_t value); // Journals a transition (ignored if the value did not change)
+        void checkpoint();           // Writes the flash checkpoint if the durable state changed since the last one
+        void exportJson(Print& out); // Writes the journal state and write costs as JSON
+
+    #ifdef JOURNAL_FAULT_INJECTION
+        void armFault(uint32_t writePoint); // Resets the device at the given write point (1 = next one)
+        const char* faultCheckResult() { return faultCheck; } // "pass" / "fail" if this boot followed an injected fault
+    #endif
+
+private:
+    // Methods
+        void compact(); // Folds the journal into the other base snapshot, journalMux must be held
+        bool replay();  // Rebuilds the state from RTC memory, false if there is no valid journal
+
+    #ifdef JOURNAL_FAULT_INJECTION
+        bool faultPoint(const JournalState& expected); // True if the device should reset here
+    #endif
+
+    // Attributes
+        JournalStorage* storage;
+        JournalState current = {};
+        JournalState checkpointed = {}; // Durable state in the flash checkpoint
+        JournalSource recoveredFrom = JournalSource::NONE;
+        uint32_t lastSequence = 0; // Sequence number of the newest record
+        uint32_t baseSequence = 0; // Sequence number folded into the active base snapshot
+        uint8_t activeBase = 0;
+
+        // Write costs
+        uint32_t writes = 0;
+        uint64_t totalWriteCycles = 0;
+        uint32_t maxWriteCycles = 0;
+        uint32_t compactions = 0;
+        uint32_t checkpoints = 0;
+        uint32_t lastCheckpointUs = 0;
+
+    #ifdef JOURNAL_FAULT_INJECTION
+        uint32_t faultCountdown = 0;
+        const char* faultCheck = "none";
+    #endif
+};
@@ -0,0 +1,160 @@
+#include "led.hpp"
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <pinout.hpp>
+
+// FreeRTOS task configuration
+#define LED_TASK_STACK_SIZE 2048
+#define LED_TASK_PRIORITY 1
+
+// Gamma 2.2, approximated as 0.8 x^2 + 0.2 x^3 so it can be evaluated at compile time
+static constexpr uint8_t gammaLevel(uint32_t i) {
+    return (4 * 255 * i * i + i * i * i + 5 * 255 * 255 / 2) / (5 * 255 * 255);
+}
+
+#define GAMMA_4(i) gammaLevel(i), gammaLevel(i + 1), gammaLevel(i + 2), gammaLevel(i + 3)
+#define GAMMA_16(i) GAMMA_4(i), GAMMA_4(i + 4), GAMMA_4(i + 8), GAMMA_4(i + 12)
+#define GAMMA_64(i) GAMMA_16(i), GAMMA_16(i + 16), GAMMA_16(i + 32), GAMMA_16(i + 48)
+static constexpr uint8_t gammaTable[256] = {GAMMA_64(0), GAMMA_64(64), GAMMA_64(128), GAMMA_64(192)};
+
+CRGB leds[LED_MAX_PIXELS];
+static CLEDController* ledController = nullptr;
+static portMUX_TYPE ledMux = portMUX_INITIALIZER_UNLOCKED;
+
+
+void LedClass::begin() {
+    setBrightness(brightness);
+
+    // Brightness and gamma are applied by our tables, dithering would make every show() differ
+        ledController = &FastLED.addLeds<WS2812B, PIN_WS2812, GRB>(leds, pixelCount);
+        FastLED.setBrightness(255);
+        FastLED.setDither(DISABLE_DITHER);
+        FastLED.clear(true);
+
+    xTaskCreate(
+        ledTask,             // Task function
+        "LedRenderer",       // Task name
+        LED_TASK_STACK_SIZE, // Stack size
+        this,                // Parameter passed to task
+        LED_TASK_PRIORITY,   // Priority
+        &taskHandle          // Task handle (notified for every new frame)
+    );
+}
+
+void LedClass::setPixelCount(uint8_t count) {
+    if (count > LED_MAX_PIXELS) count = LED_MAX_PIXELS;
+
+    portENTER_CRITICAL(&ledMux);
+        pixelCount = count;
+        ledController->setLeds(leds, count);
+    portEXIT_CRITICAL(&ledMux);
+}
+
+void LedClass::setBrightness(uint8_t newBrightness) {
+    brightness = newBrightness;
+
+    // Scale the gamma table, anything that was lit stays lit (at least level 1)
+    for (int i = 0; i < 256; i++) {
+        uint32_t level = (uint32_t)gammaTable[i] * brightness / 255;
+        if (level == 0 && i > 0 && brightness > 0) level = 1;
+        levels[i] = level;
+    }
+}
+
+uint8_t LedClass::gamma(uint8_t level) {
+    return gammaTable[level];
+}
+
+bool LedClass::submit(const CRGB* frame, uint8_t tag) {
+    if (tag >= LED_STAT_SLOTS) tag = LED_STAT_SLOTS - 1;
+    stats[tag].composed++;
+
+    // Correct the frame
+        uint8_t count = pixelCount;
+        CRGB corrected[LED_MAX_PIXELS];
+        for (uint8_t i = 0; i < count; i++) {
+            corrected[i] = CRGB(levels[frame[i].r], levels[frame[i].g], levels[frame[i].b]);
+        }
+
+    // Hand it to the LED task if it differs from the last one
+        bool changed = false;
+        portENTER_CRITICAL(&ledMux);
+            if (memcmp(corrected, pending, count * sizeof(CRGB)) != 0) {
+                memcpy(pending, corrected, count * sizeof(CRGB));
+                pendingTag = tag;
+                changed = true;
+            }
+        portEXIT_CRITICAL(&ledMux);
+
+        if (changed) {
+            stats[tag].changed++;
+            if (taskHandle != NULL) xTaskNotifyGive(taskHandle);
+        }
+        return changed;
+}
+
+void LedClass::ledTask(void* parameter) {
+    LedClass* instance = static_cast<LedClass*>(parameter);
+
+    while (true) {
+        // Notifications coalesce, so frames submitted during a transfer collapse into the newest one
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        instance->push();
+    }
+}
+
+void LedClass::push() {
+    uint8_t tag;
+    portENTER_CRITICAL(&ledMux);
+        memcpy(leds, pending, pixelCount * sizeof(CRGB));
+        tag = pendingTag;
+    portEXIT_CRITICAL(&ledMux);
+
+    int64_t start = esp_timer_get_time();
+    FastLED.show();
+    uint32_t duration = esp_timer_get_time() - start;
+
+    lastPushUs = duration;
+    if (duration > maxPushUs) maxPushUs = duration;
+    stats[tag].pushed++;
+}
+
+CHSV LedClass::sample(const LedAnimation& animation, uint32_t timeMs) {
+    const LedKeyframe* keyframes = animation.keyframes;
+    if (animation.periodMs > 0) timeMs %= animation.periodMs;
+
+    // Find the segment we are in
+        uint8_t i = 0;
+        while (i + 1 < animation.count && keyframes[i + 1].timeMs <= timeMs) i++;
+
+        const LedKeyframe& from = keyframes[i];
+        const LedKeyframe* to;
+        uint32_t toTime;
+        if (i + 1 < animation.count) {
+            to = &keyframes[i + 1];
+            toTime = to->timeMs;
+        } else if (animation.periodMs > 0) {
+            to = &keyframes[0]; // Loop back to the start
+            toTime = animation.periodMs;
+        } else {
+            return CHSV(from.hue, from.saturation, from.value); // Hold the last keyframe
+        }
+
+    // Interpolate, the hue takes the shorter way around the color wheel
+        uint32_t fraction = toTime > from.timeMs ? (timeMs - from.timeMs) * 256 / (toTime - from.timeMs) : 0;
+        uint8_t hue = from.hue + (int8_t)(to->hue - from.hue) * (int32_t)fraction / 256;
+        uint8_t saturation = from.saturation + ((int32_t)to->saturation - from.saturation) * (int32_t)fraction / 256;
+        uint8_t value = from.value + ((int32_t)to->value - from.value) * (int32_t)fraction / 256;
+        return CHSV(hue, saturation, value);
+}
+
+void LedClass::exportJson(Print& out) {
+    out.printf("{\"pixels\":%u,\"brightness\":%u,\"lastPushUs\":%u,\"maxPushUs\":%u,\"frames\":[",
+        (unsigned)pixelCount, (unsigned)brightness, (unsigned)lastPushUs, (unsigned)maxPushUs);
+    for (int i = 0; i < LED_STAT_SLOTS; i++) {
+        out.printf("%s{\"composed\":%u,\"changed\":%u,\"pushed\":%u}", i == 0 ? "" : ",",
+            (unsigned)stats[i].composed, (unsigned)stats[i].changed, (unsigned)stats[i].pushed);
+    }
+    out.print("]}");
+}
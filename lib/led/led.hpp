@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+#include <Print.h>
+#include <FastLED.h>
+#include <expander.hpp>
+// This module drives the WS2812B strip (status pixel followed by one pixel per compartment).
+//  - The output worker composes frames and hands them over with submit(). The transfer runs in the LED task,
+//    so the output worker never waits for the strip (FastLED sends through the RMT peripheral on the ESP32).
+//  - A frame is only pushed if it differs from the last submitted one, a static strip costs no transfers at all.
+//    Frames submitted while a transfer is running replace each other, only the newest one is pushed.
+//  - Colors are corrected with a gamma table (built at compile time) and a brightness table
+//    (rebuilt only when the brightness changes), FastLED itself runs at full brightness without dithering.
+//  - Animations are keyframe tracks, sampled with linear interpolation.
+
+#define LED_MAX_PIXELS (1 + MAX_COMPARTMENTS)
+#define LED_STAT_SLOTS 8 // Frame counters, indexed by the tag passed to submit() (the output state)
+
+struct LedKeyframe {
+    uint16_t timeMs; // Offset from the start of the track
+    uint8_t hue;
+    uint8_t saturation;
+    uint8_t value;
+};
+
+struct LedAnimation {
+    const LedKeyframe* keyframes; // Sorted by time, the first one at 0
+    uint8_t count;
+    uint16_t periodMs; // Length of the loop (fades back to the first keyframe), 0 = plays once and holds the last keyframe
+};
+
+struct LedFrameStats {
+    uint32_t composed; // Frames submitted
+    uint32_t changed;  // Frames that differed from the previous one (handed to the LED task)
+    uint32_t pushed;   // Frames sent to the strip
+};
+
+class LedClass {
+public:
+    // Methods
+        void begin(); // Initializes FastLED and starts the LED task
+        void setPixelCount(uint8_t count);     // Number of pixels on the strip (at most LED_MAX_PIXELS)
+        void setBrightness(uint8_t brightness); // Rebuilds the brightness table
+        bool submit(const CRGB* frame, uint8_t tag); // Queues a frame (linear colors) for the strip, returns true if it changed
+        void push(); // Sends the last submitted frame to the strip (run by the LED task)
+        const LedFrameStats& frameStats(uint8_t tag) { return stats[tag]; }
+        void exportJson(Print& out); // Writes the frame counters and transfer times as JSON
+
+        static CHSV sample(const LedAnimation& animation, uint32_t timeMs); // Color of the animation at the given time
+        static uint8_t gamma(uint8_t level); // Gamma corrected level, before brightness
+
+private:
+    // Methods
+        static void ledTask(void* parameter); // FreeRTOS task function
+
+    // Attributes
+        uint8_t levels[256]; // Gamma and brightness corrected channel levels
+        uint8_t brightness = 255;
+        volatile uint8_t pixelCount = 1;
+
+        CRGB pending[LED_MAX_PIXELS]; // Last submitted frame (corrected)
+        uint8_t pendingTag = 0;
+        LedFrameStats stats[LED_STAT_SLOTS] = {};
+        uint32_t lastPushUs = 0; // Duration of the last show()
+        uint32_t maxPushUs = 0;
+        TaskHandle_t taskHandle = NULL;
+};
@@ -0,0 +1,117 @@
+#include "metrics.hpp"
+#include <Arduino.h>
+#include <esp_attr.h>
+#include <esp_sleep.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+
+#define METRICS_MAGIC 0x4D455432 // "MET2", marks the RTC histograms as initialized (with the current layout)
+
+// Histograms in RTC memory (not cleared on deep sleep or software reset)
+RTC_NOINIT_ATTR static uint32_t metricsMagic;
+RTC_NOINIT_ATTR static LatencyHistogram histograms[(int)LatencyPath::COUNT];
+
+static const char* pathNames[] = {"hatchToOutput", "dueToAlert", "wakeToOutput", "httpRequest"};
+static portMUX_TYPE metricsMux = portMUX_INITIALIZER_UNLOCKED;
+
+void MetricsClass::begin() {
+    // Initialize the histograms after power on (RTC memory contains garbage)
+        if (metricsMagic != METRICS_MAGIC || esp_reset_reason() == ESP_RST_POWERON) {
+            memset(histograms, 0, sizeof(histograms));
+            metricsMagic = METRICS_MAGIC;
+        }
+
+    for (int i = 0; i < (int)LatencyPath::COUNT; i++) {
+        pendingStart[i] = METRICS_NOT_PENDING;
+    }
+
+    // esp_timer starts counting at boot, which is the moment we woke up
+        esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+        if (cause == ESP_SLEEP_WAKEUP_EXT0 || cause == ESP_SLEEP_WAKEUP_EXT1 || cause == ESP_SLEEP_WAKEUP_TIMER) {
+            startAt(LatencyPath::WAKE_TO_OUTPUT, 0);
+        }
+}
+
+void MetricsClass::start(LatencyPath path) {
+    startAt(path, esp_timer_get_time());
+}
+
+void MetricsClass::startAt(LatencyPath path, int64_t timeUs) {
+    portENTER_CRITICAL(&metricsMux);
+        pendingStart[(int)path] = timeUs;
+    portEXIT_CRITICAL(&metricsMux);
+}
+
+void MetricsClass::stop(LatencyPath path) {
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&metricsMux);
+        int64_t startUs = pendingStart[(int)path];
+        pendingStart[(int)path] = METRICS_NOT_PENDING;
+    portEXIT_CRITICAL(&metricsMux);
+
+    if (startUs == METRICS_NOT_PENDING) return;
+
+    int64_t latency = now - startUs;
+    if (latency > METRICS_PENDING_TIMEOUT_US) {
+        // The reaction came too late to belong to this start
+        portENTER_CRITICAL(&metricsMux);
+            histograms[(int)path].expired++;
+        portEXIT_CRITICAL(&metricsMux);
+        return;
+    }
+    if (latency < 0) latency = 0;
+    record(path, latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency);
+}
+
+void MetricsClass::record(LatencyPath path, uint32_t latencyUs) {
+    uint32_t bucket = latencyUs == 0 ? 0 : 31 - __builtin_clz(latencyUs);
+    if (bucket >= METRICS_BUCKETS) bucket = METRICS_BUCKETS - 1;
+
+    portENTER_CRITICAL(&metricsMux);
+        LatencyHistogram& h = histograms[(int)path];
+        h.buckets[bucket]++;
+        h.count++;
+        h.sumUs += latencyUs;
+        if (latencyUs > h.maxUs) h.maxUs = latencyUs;
+    portEXIT_CRITICAL(&metricsMux);
+}
+
+uint32_t MetricsClass::percentile(LatencyPath path, uint8_t percent) {
+    const LatencyHistogram& h = histograms[(int)path];
+    if (h.count == 0) return 0;
+
+    // Rank of the sample we are looking for (rounded up, at least the first one)
+    uint64_t rank = ((uint64_t)h.count * percent + 99) / 100;
+    if (rank == 0) rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        seen += h.buckets[i];
+        if (seen >= rank) {
+            // Upper bound of the bucket, but never above the largest value we actually saw
+            uint64_t upper = (2ULL << i) - 1;
+            return upper < h.maxUs ? (uint32_t)upper : h.maxUs;
+        }
+    }
+    return h.maxUs;
+}
+
+void MetricsClass::exportJson(Print& out) {
+    out.print("{");
+    for (int p = 0; p < (int)LatencyPath::COUNT; p++) {
+        LatencyPath path = (LatencyPath)p;
+        const LatencyHistogram& h = histograms[p];
+
+        out.printf("%s\"%s\":{\"count\":%u,\"expired\":%u,\"meanUs\":%u,\"p50Us\":%u,\"p90Us\":%u,\"p99Us\":%u,\"maxUs\":%u,\"buckets\":[",
+            p == 0 ? "" : ",", pathNames[p], (unsigned)h.count, (unsigned)h.expired,
+            h.count ? (unsigned)(h.sumUs / h.count) : 0u,
+            (unsigned)percentile(path, 50), (unsigned)percentile(path, 90),
+            (unsigned)percentile(path, 99), (unsigned)h.maxUs);
+        for (int i = 0; i < METRICS_BUCKETS; i++) {
+            out.printf("%s%u", i == 0 ? "" : ",", (unsigned)h.buckets[i]);
+        }
+        out.print("]}");
+    }
+    out.print("}");
+}
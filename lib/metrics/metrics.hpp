@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+#include <Print.h>
+// This module measures end-to-end latencies against our SLAs.
+//  - Every path has a fixed log-scale histogram: bucket N counts latencies in [2^N, 2^(N+1)) microseconds.
+//  - A measurement is a start() and a matching stop(), both just store a timestamp / bump a counter.
+//    A start() while one is pending restarts it (the latest event counts).
+//  - A pending measurement that is not stopped within METRICS_PENDING_TIMEOUT_US is discarded and counted as expired,
+//    so an event without an output reaction can't be matched to an unrelated reaction much later.
+//  - The histograms live in RTC memory and survive deep sleep as well as software resets.
+//  - Percentiles are reported as the upper bound of the bucket they fall into (worst case).
+
+#define METRICS_BUCKETS 32 // 2^31 us is about 36 minutes, everything above lands in the last bucket
+#define METRICS_PENDING_TIMEOUT_US 10000000 // 10 s
+#define METRICS_NOT_PENDING INT64_MIN // Start time of a path without a pending measurement (starts before boot are negative)
+
+// Table of paths, every start is followed by an output reaction, the stops are all in the output worker when it renders it:
+//  - HATCH_TO_OUTPUT: Starts at a main hatch edge while awake, or when a compartment with a dose due is opened
+//    (input task, through the output's setters). Stops when the output state changes (HATCH_OPEN shown or left)
+//    or a compartment pixel goes dark.
+//  - DUE_TO_ALERT: Starts at the scheduled due time of a timer wakeup (sleep system, backdated before boot).
+//    Stops when a due compartment pixel lights up or NOTIFICATION_PHASE_1 begins.
+//  - WAKE_TO_OUTPUT: Starts at boot after a wakeup (hatch, compartment or timer).
+//    Stops at the first frame and GPIO levels of a state other than OFF (the sleep system woke the outputs).
+//  - HTTP_REQUEST: Server handler start until the response was sent.
+enum class LatencyPath : uint8_t {
+    HATCH_TO_OUTPUT,
+    DUE_TO_ALERT,
+    WAKE_TO_OUTPUT,
+    HTTP_REQUEST,
+    COUNT
+};
+
+struct LatencyHistogram {
+    uint32_t buckets[METRICS_BUCKETS];
+    uint32_t count;
+    uint32_t expired; // Pending measurements discarded after METRICS_PENDING_TIMEOUT_US
+    uint32_t maxUs;
+    uint64_t sumUs;
+};
+
+class MetricsClass {
+public:
+    // Methods
+        void begin(); // Validates the RTC histograms and starts WAKE_TO_OUTPUT after a wakeup
+        void start(LatencyPath path);                    // Starts a measurement now
+        void startAt(LatencyPath path, int64_t timeUs);  // Starts a measurement at a past esp_timer timestamp (negative before boot)
+        void stop(LatencyPath path);                     // Records the latency if a measurement is pending (and not expired)
+        void record(LatencyPath path, uint32_t latencyUs); // Adds a latency to the histogram
+        uint32_t percentile(LatencyPath path, uint8_t percent); // Upper bound of the percentile in us, 0 if empty
+        void exportJson(Print& out); // Writes all histograms with percentiles as JSON
+
+private:
+    // Attributes
+        int64_t pendingStart[(int)LatencyPath::COUNT]; // esp_timer timestamp of pending measurements, METRICS_NOT_PENDING if none
+};
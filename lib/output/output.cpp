@@ -1,11 +1,22 @@
 #include "output.hpp"
 #include <Arduino.h>
-#include <FastLED.h>
 #include <pinout.hpp>
+#include <trace.hpp>
+#include <metrics.hpp>
+#include <power.hpp>
+#include <led.hpp>
+#include <journal.hpp>
+
+extern TraceClass trace;
+extern MetricsClass metrics;
+extern PowerClass power;
+extern LedClass led;
+extern JournalClass journal;
 
 // WS2812B LED strip configuration
-#define NUM_PIXELS 1
-CRGB leds[NUM_PIXELS];
+// Pixel 0 is the status pixel, pixel 1 + N belongs to compartment N
+#define COMPARTMENT_DUE_COLOR CRGB::Orange
+#define BATTERY_GAUGE_MAX_HUE 96 // Green at 100%, red at 0%
 
 // Timing constants (in milliseconds)
 #define BUILT_IN_BLINK_INTERVAL 200
@@ -15,8 +26,30 @@ CRGB leds[NUM_PIXELS];
 #define BUZZ_PHASE4_INTERVAL 500
 #define BEEP_PHASE3_INTERVAL 1000
 #define BEEP_PHASE4_INTERVAL 500
-#define BUZZ_DURATION 200
-#define BEEP_DURATION 100
+#define BUZZ_DURATION 200 // At 100% alert duty (see power governor)
+#define BEEP_DURATION 100 // At 100% alert duty (see power governor)
+#define BREATH_STEP_MS 40 // Breathing advances at 25 Hz, smooth to the eye with a quarter of the strip transfers
+
+// Status pixel battery gauge, fades in when the hatch opens (hue is replaced by the state of charge)
+static const LedKeyframe gaugeKeyframes[] = {{0, 0, 255, 0}, {300, 0, 255, 255}};
+static const LedAnimation gaugeAnimation = {gaugeKeyframes, 2, 0};
+
+// Status pixel low battery warning while awake (LOW_BATTERY and CRITICAL tiers), a short red flash every 4 s
+static const LedKeyframe lowBatteryKeyframes[] = {{0, HUE_RED, 255, 0}, {150, HUE_RED, 255, 255}, {300, HUE_RED, 255, 0}};
+static const LedAnimation lowBatteryAnimation = {lowBatteryKeyframes, 3, 4000};
+
+// Status pixel breathing during alerts, one breath per buzz interval, warmer colors as the alert escalates.
+// The track starts at the buzz (see renderFrame), so the pixel is brightest while the motor runs.
+static const LedKeyframe phase1Keyframes[] = {{0, HUE_YELLOW, 255, 255}, {BUZZ_PHASE1_INTERVAL / 2, HUE_YELLOW, 255, 16}};
+static const LedKeyframe phase2Keyframes[] = {{0, HUE_ORANGE, 255, 255}, {BUZZ_PHASE2_INTERVAL / 2, HUE_ORANGE, 255, 16}};
+static const LedKeyframe phase3Keyframes[] = {{0, HUE_ORANGE / 2, 255, 255}, {BUZZ_PHASE3_INTERVAL / 2, HUE_ORANGE / 2, 255, 16}};
+static const LedKeyframe phase4Keyframes[] = {{0, HUE_RED, 255, 255}, {BUZZ_PHASE4_INTERVAL / 2, HUE_RED, 255, 16}};
+static const LedAnimation phaseAnimations[] = {
+    {phase1Keyframes, 2, BUZZ_PHASE1_INTERVAL},
+    {phase2Keyframes, 2, BUZZ_PHASE2_INTERVAL},
+    {phase3Keyframes, 2, BUZZ_PHASE3_INTERVAL},
+    {phase4Keyframes, 2, BUZZ_PHASE4_INTERVAL}
+};
 
 // FreeRTOS task configuration
 #define WORKER_TASK_STACK_SIZE 2048
@@ -36,12 +69,6 @@ void OuptutClass::begin() {
     pinMode(PIN_BUZZER, OUTPUT);
     pinMode(PIN_VIBE, OUTPUT);
     
-    // Initialize FastLED for WS2812B
-    FastLED.addLeds<WS2812B, PIN_WS2812, GRB>(leds, NUM_PIXELS);
-    FastLED.setBrightness(50); // Set brightness (0-255)
-    FastLED.clear();
-    FastLED.show();
-    
     // Set initial state
     currentState = OutputState::OFF;
     
@@ -65,175 +92,278 @@ void OuptutClass::begin() {
 
 void OuptutClass::setState(OutputState newState) {
     currentState = newState;
+    journal.record(JournalField::OUTPUT_STATE, (uint32_t)newState); // Restored after a reset
+}
+
+void OuptutClass::setCompartmentCount(uint8_t count) {
+    compartmentCount = count;
+    led.setPixelCount(1 + count);
+}
+
+void OuptutClass::setDueCompartments(uint32_t mask) {
+    dueCompartments = mask;
+}
+
+void OuptutClass::setHatchOpen(bool open) {
+    // The worker shows HATCH_OPEN while the hatch is open, so every edge while awake changes the output
+    bool visible = currentState != OutputState::OFF && currentState != OutputState::HATCH_OPEN;
+    if (open != hatchOpen && visible) metrics.start(LatencyPath::HATCH_TO_OUTPUT);
+    hatchOpen = open;
+}
+
+void OuptutClass::setOpenCompartments(uint32_t mask) {
+    // Opening a due compartment darkens its pixel, other compartment edges change nothing
+    uint32_t opened = mask & ~openCompartments;
+    if ((opened & dueCompartments) && currentState != OutputState::OFF) metrics.start(LatencyPath::HATCH_TO_OUTPUT);
+    openCompartments = mask;
 }
 
 void OuptutClass::outputTask(void* parameter) {
     OuptutClass* instance = static_cast<OuptutClass*>(parameter);
     
     // Timing variables
-    unsigned long lastBlinkTime = 0;
-    unsigned long lastBuzzTime = 0;
-    unsigned long lastBeepTime = 0;
-    bool blinkState = false;
-    bool buzzActive = false;
-    bool beepActive = false;
-    unsigned long buzzStartTime = 0;
-    unsigned long beepStartTime = 0;
+    OutputPattern pattern;
+    OutputState lastState = OutputState::OFF;
+    unsigned long stateStartTime = millis();
+    uint32_t shownDue = 0; // Compartment pixels lit in the last frame
+    bool awake = false;    // A frame other than OFF was shown since boot
+    uint8_t brightness = power.policy().ledBrightness;
+    led.setBrightness(brightness); // Scaled by the power governor
     
     // Infinite loop - runs continuously in the background
     while (true) {
         unsigned long currentTime = millis();
         OutputState state = instance->currentState;
 
-        // Blink built in led if not OFF
-            if (state != OutputState::OFF) {
-                if (currentTime - lastBlinkTime >= BUILT_IN_BLINK_INTERVAL) {
-                    blinkState = !blinkState;
-                    digitalWrite(PIN_LED_BUILTIN, blinkState ? HIGH : LOW);
-                    lastBlinkTime = currentTime;
+        // The open hatch takes over while awake (battery gauge), opened compartments go dark right away
+            if (instance->hatchOpen && state != OutputState::OFF) {
+                state = OutputState::HATCH_OPEN;
+            }
+            uint32_t due = instance->dueCompartments & ~instance->openCompartments;
+
+        // Record state changes
+            if (state != lastState) {
+                trace.record(TraceTask::OUTPUT_WORKER, TraceEvent::OUTPUT_STATE, (uint32_t)state);
+                metrics.stop(LatencyPath::HATCH_TO_OUTPUT);
+                if (state == OutputState::NOTIFICATION_PHASE_1) {
+                    metrics.stop(LatencyPath::DUE_TO_ALERT);
                 }
-            }else{
-                digitalWrite(PIN_LED_BUILTIN, LOW);
+                lastState = state;
+                stateStartTime = currentTime;
             }
 
-        // Show battery state if HATCH_OPEN
-            if (state != OutputState::OFF && state != OutputState::ON) {
-                // For simplicity, show green for now
-                leds[0] = CRGB::Green;
-                FastLED.show();
-            }else{
-                // Turn off LEDs
-                leds[0] = CRGB::Black;
-                FastLED.show();
+        // Apply the power tier: LED brightness and alert pulse lengths
+            const PowerPolicy& policy = power.policy();
+            if (policy.ledBrightness != brightness) {
+                brightness = policy.ledBrightness;
+                led.setBrightness(brightness);
             }
+            unsigned long buzzDuration = BUZZ_DURATION * policy.alertDutyPercent / 100;
+            unsigned long beepDuration = BEEP_DURATION * policy.alertDutyPercent / 100;
 
-        // Handle output states
-            switch (state) {
-                case OutputState::OFF:
-                    // All outputs off
-                    digitalWrite(PIN_BUZZER, LOW);
-                    digitalWrite(PIN_VIBE, LOW);
-                    break;
-
-                case OutputState::ON:
-                    // All outputs off
-                    digitalWrite(PIN_BUZZER, LOW);
-                    digitalWrite(PIN_VIBE, LOW);
-                    break;
-
-                case OutputState::HATCH_OPEN:
-                    // Buzzer and vibe off
-                    digitalWrite(PIN_BUZZER, LOW);
-                    digitalWrite(PIN_VIBE, LOW);
-                    break;
-
-                case OutputState::NOTIFICATION_PHASE_1:
-                    if (!buzzActive && currentTime - lastBuzzTime >= BUZZ_PHASE1_INTERVAL) {
-                        buzzActive = true;
-                        buzzStartTime = currentTime;
-                        lastBuzzTime = currentTime;
-                    }
+        // Handle output states (first, the breathing follows the buzz it may start now)
+            OutputLevels levels = patternStep(state, currentTime, buzzDuration, beepDuration, pattern);
+            digitalWrite(PIN_LED_BUILTIN, levels.builtInLed ? HIGH : LOW);
+            digitalWrite(PIN_BUZZER, levels.buzzer ? HIGH : LOW);
+            digitalWrite(PIN_VIBE, levels.vibe ? HIGH : LOW);
 
-                    if (buzzActive) {
-                        if (currentTime - buzzStartTime < BUZZ_DURATION) {
-                            digitalWrite(PIN_VIBE, HIGH);
-                        } else {
-                            digitalWrite(PIN_VIBE, LOW);
-                            buzzActive = false;
-                        }
-                    }
+        // Render the LED frame (the LED task only pushes it if it changed)
+            CRGB frame[LED_MAX_PIXELS];
+            renderFrame(frame, state, due, instance->compartmentCount, currentTime - stateStartTime,
+                        currentTime - pattern.lastBuzzTime, power.stateOfCharge());
+            led.submit(frame, (uint8_t)state);
 
-                    digitalWrite(PIN_BUZZER, LOW);
-                    break;
+        // Record the reactions of the compartment pixels: lighting up (dose due) or going dark (dose taken)
+            uint32_t visibleDue = state != OutputState::OFF ? due : 0;
+            if (visibleDue & ~shownDue) metrics.stop(LatencyPath::DUE_TO_ALERT);
+            if (shownDue & ~visibleDue) metrics.stop(LatencyPath::HATCH_TO_OUTPUT);
+            shownDue = visibleDue;
 
-                case OutputState::NOTIFICATION_PHASE_2:
-                    if (!buzzActive && currentTime - lastBuzzTime >= BUZZ_PHASE2_INTERVAL) {
-                        buzzActive = true;
-                        buzzStartTime = currentTime;
-                        lastBuzzTime = currentTime;
-                    }
+            if (!awake && state != OutputState::OFF) {
+                metrics.stop(LatencyPath::WAKE_TO_OUTPUT); // First frame and GPIO levels of the woken device
+                awake = true;
+            }
 
-                    if (buzzActive) {
-                        if (currentTime - buzzStartTime < BUZZ_DURATION) {
-                            digitalWrite(PIN_VIBE, HIGH);
-                        } else {
-                            digitalWrite(PIN_VIBE, LOW);
-                            buzzActive = false;
-                        }
-                    }
+            // Small delay to prevent task from hogging CPU
+            vTaskDelay(pdMS_TO_TICKS(WORKER_TASK_DELAY_MS));
+        }
+}
 
-                    digitalWrite(PIN_BUZZER, LOW);
-                    break;
-
-                case OutputState::NOTIFICATION_PHASE_3:
-                    // Buzzing
-                        if (!buzzActive && currentTime - lastBuzzTime >= BUZZ_PHASE3_INTERVAL) {
-                            buzzActive = true;
-                            buzzStartTime = currentTime;
-                            lastBuzzTime = currentTime;
-                        }
-
-                        if (buzzActive) {
-                            if (currentTime - buzzStartTime < BUZZ_DURATION) {
-                                digitalWrite(PIN_VIBE, HIGH);
-                            } else {
-                                digitalWrite(PIN_VIBE, LOW);
-                                buzzActive = false;
-                            }
-                        }
-
-                    // Beeping
-                        if (!beepActive && currentTime - lastBeepTime >= BEEP_PHASE3_INTERVAL) {
-                            beepActive = true;
-                            beepStartTime = currentTime;
-                            lastBeepTime = currentTime;
-                        }
-
-                        if (beepActive) {
-                            if (currentTime - beepStartTime < BEEP_DURATION) {
-                                digitalWrite(PIN_BUZZER, HIGH);
-                            } else {
-                                digitalWrite(PIN_BUZZER, LOW);
-                                beepActive = false;
-                            }
-                        }
-                    break;
-
-                case OutputState::NOTIFICATION_PHASE_4:
-                    // Buzzing
-                    if (!buzzActive && currentTime - lastBuzzTime >= BUZZ_PHASE4_INTERVAL) {
-                        buzzActive = true;
-                        buzzStartTime = currentTime;
-                        lastBuzzTime = currentTime;
-                    }
+void OuptutClass::renderFrame(CRGB* frame, OutputState state, uint32_t due, uint8_t compartmentCount,
+                              unsigned long stateTime, unsigned long buzzTime, uint8_t soc) {
+    // Status pixel
+        switch (state) {
+            case OutputState::HATCH_OPEN: {
+                // Battery gauge, red (empty) through yellow to green (full)
+                CHSV gauge = LedClass::sample(gaugeAnimation, stateTime);
+                gauge.hue = soc * BATTERY_GAUGE_MAX_HUE / 100;
+                frame[0] = gauge;
+                break;
+            }
+            case OutputState::ON:
+                // Below the SAVING range, the LOW_BATTERY and CRITICAL tiers
+                if (soc < PowerClass::policyOf(PowerTier::SAVING).minSoc) {
+                    frame[0] = LedClass::sample(lowBatteryAnimation, stateTime);
+                } else {
+                    frame[0] = CRGB::Black;
+                }
+                break;
+            case OutputState::NOTIFICATION_PHASE_1:
+            case OutputState::NOTIFICATION_PHASE_2:
+            case OutputState::NOTIFICATION_PHASE_3:
+            case OutputState::NOTIFICATION_PHASE_4:
+                // Whole steps since the buzz, the step of the buzz itself stays the brightest
+                frame[0] = LedClass::sample(phaseAnimations[(int)state - (int)OutputState::NOTIFICATION_PHASE_1],
+                                            buzzTime - buzzTime % BREATH_STEP_MS);
+                break;
+            default:
+                frame[0] = CRGB::Black;
+        }
 
-                    if (buzzActive) {
-                        if (currentTime - buzzStartTime < BUZZ_DURATION) {
-                            digitalWrite(PIN_VIBE, HIGH);
-                        } else {
-                            digitalWrite(PIN_VIBE, LOW);
-                            buzzActive = false;
-                        }
-                    }
+    // Light up the compartments with a dose due
+        for (uint8_t i = 0; i < compartmentCount; i++) {
+            bool isDue = state != OutputState::OFF && ((due >> i) & 1);
+            frame[1 + i] = isDue ? CRGB(COMPARTMENT_DUE_COLOR) : CRGB(CRGB::Black);
+        }
+}
+
+OutputLevels OuptutClass::patternStep(OutputState state, unsigned long currentTime, unsigned long buzzDuration, unsigned long beepDuration, OutputPattern& p) {
+    OutputLevels levels = {false, false, false};
+
+    // Blink built in led if not OFF
+        if (state != OutputState::OFF) {
+            if (currentTime - p.lastBlinkTime >= BUILT_IN_BLINK_INTERVAL) {
+                p.blinkState = !p.blinkState;
+                p.lastBlinkTime = currentTime;
+            }
+            levels.builtInLed = p.blinkState;
+        }
+
+    // Buzz / beep pattern of the state
+    switch (state) {
+        case OutputState::OFF:
+            // All outputs off
+            levels.buzzer = false;
+            levels.vibe = false;
+            break;
+
+        case OutputState::ON:
+            // All outputs off
+            levels.buzzer = false;
+            levels.vibe = false;
+            break;
+
+        case OutputState::HATCH_OPEN:
+            // Buzzer and vibe off
+            levels.buzzer = false;
+            levels.vibe = false;
+            break;
+
+        case OutputState::NOTIFICATION_PHASE_1:
+            if (!p.buzzActive && currentTime - p.lastBuzzTime >= BUZZ_PHASE1_INTERVAL) {
+                p.buzzActive = true;
+                p.buzzStartTime = currentTime;
+                p.lastBuzzTime = currentTime;
+            }
+
+            if (p.buzzActive) {
+                if (currentTime - p.buzzStartTime < buzzDuration) {
+                    levels.vibe = true;
+                } else {
+                    levels.vibe = false;
+                    p.buzzActive = false;
+                }
+            }
+
+            levels.buzzer = false;
+            break;
+
+        case OutputState::NOTIFICATION_PHASE_2:
+            if (!p.buzzActive && currentTime - p.lastBuzzTime >= BUZZ_PHASE2_INTERVAL) {
+                p.buzzActive = true;
+                p.buzzStartTime = currentTime;
+                p.lastBuzzTime = currentTime;
+            }
+
+            if (p.buzzActive) {
+                if (currentTime - p.buzzStartTime < buzzDuration) {
+                    levels.vibe = true;
+                } else {
+                    levels.vibe = false;
+                    p.buzzActive = false;
+                }
+            }
+
+            levels.buzzer = false;
+            break;
+
+        case OutputState::NOTIFICATION_PHASE_3:
+            // Buzzing
+                if (!p.buzzActive && currentTime - p.lastBuzzTime >= BUZZ_PHASE3_INTERVAL) {
+                    p.buzzActive = true;
+                    p.buzzStartTime = currentTime;
+                    p.lastBuzzTime = currentTime;
+                }
 
-                    // Beeping
-                    if (!beepActive && currentTime - lastBeepTime >= BEEP_PHASE4_INTERVAL) {
-                        beepActive = true;
-                        beepStartTime = currentTime;
-                        lastBeepTime = currentTime;
+                if (p.buzzActive) {
+                    if (currentTime - p.buzzStartTime < buzzDuration) {
+                        levels.vibe = true;
+                    } else {
+                        levels.vibe = false;
+                        p.buzzActive = false;
                     }
+                }
 
-                    if (beepActive) {
-                        if (currentTime - beepStartTime < BEEP_DURATION) {
-                            digitalWrite(PIN_BUZZER, HIGH);
-                        } else {
-                            digitalWrite(PIN_BUZZER, LOW);
-                            beepActive = false;
-                        }
+            // Beeping
+                if (!p.beepActive && currentTime - p.lastBeepTime >= BEEP_PHASE3_INTERVAL) {
+                    p.beepActive = true;
+                    p.beepStartTime = currentTime;
+                    p.lastBeepTime = currentTime;
+                }
+
+                if (p.beepActive) {
+                    if (currentTime - p.beepStartTime < beepDuration) {
+                        levels.buzzer = true;
+                    } else {
+                        levels.buzzer = false;
+                        p.beepActive = false;
                     }
+                }
+            break;
+
+        case OutputState::NOTIFICATION_PHASE_4:
+            // Buzzing
+            if (!p.buzzActive && currentTime - p.lastBuzzTime >= BUZZ_PHASE4_INTERVAL) {
+                p.buzzActive = true;
+                p.buzzStartTime = currentTime;
+                p.lastBuzzTime = currentTime;
             }
 
-            // Small delay to prevent task from hogging CPU
-            vTaskDelay(pdMS_TO_TICKS(WORKER_TASK_DELAY_MS));
-        }
+            if (p.buzzActive) {
+                if (currentTime - p.buzzStartTime < buzzDuration) {
+                    levels.vibe = true;
+                } else {
+                    levels.vibe = false;
+                    p.buzzActive = false;
+                }
+            }
+
+            // Beeping
+            if (!p.beepActive && currentTime - p.lastBeepTime >= BEEP_PHASE4_INTERVAL) {
+                p.beepActive = true;
+                p.beepStartTime = currentTime;
+                p.lastBeepTime = currentTime;
+            }
+
+            if (p.beepActive) {
+                if (currentTime - p.beepStartTime < beepDuration) {
+                    levels.buzzer = true;
+                } else {
+                    levels.buzzer = false;
+                    p.beepActive = false;
+                }
+            }
+    }
+
+    return levels;
 }
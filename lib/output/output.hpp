@@ -1,20 +1,23 @@
 #pragma once
+#include <stdint.h>
+#include <FastLED.h>
 // This module is responisble for managing the outpit devices, manely the:
 //  - LED BUILTIN
 //  - WS2812B
 //  - Beeper (Buzzer)
 //  - Vibration Motor
+//  - Compartment WS2812B pixels (chained after the status pixel)
 
 // It provides a api to set the state of the outputs. The worker will automaticly control the GPIOs based on the selected state.
 // Table of states:
 //  - OFF: Active when device is sleeping. All outputs are off.
-//  - ON: Active when the device is awake, but no other states are active. LED BUILTIN is blinking ON.
+//  - ON: Active when the device is awake, but no other states are active. LED BUILTIN is blinking ON. WS2812B flashes red on a low battery.
 //  - HATCH_OPEN: Active when device is awake but no notifications are active. LED BUILTIN is blinking
-//  - HATCH_OPEN: Active when the hatch is open. WS2812B color is determined by battery level.
-//  - NOTIFICATION_PHASE_1: Vibrating ocasionaly.
-//  - NOTIFICATION_PHASE_2: Vibrating more often.
-//  - NOTIFICATION_PHASE_3: Starts beeping (slowly) too.
-//  - NOTIFICATION_PHASE_4: Vibrating and beeping rapidly.
+//  - HATCH_OPEN: Active when the hatch is open (shown while awake, over any other state). WS2812B color is determined by battery level.
+//  - NOTIFICATION_PHASE_1: Vibrating ocasionaly. WS2812B breathing yellow.
+//  - NOTIFICATION_PHASE_2: Vibrating more often. WS2812B breathing orange.
+//  - NOTIFICATION_PHASE_3: Starts beeping (slowly) too. WS2812B breathing red-orange.
+//  - NOTIFICATION_PHASE_4: Vibrating and beeping rapidly. WS2812B breathing red.
 
 enum class OutputState {
     OFF,
@@ -26,11 +29,44 @@ enum class OutputState {
     NOTIFICATION_PHASE_4
 };
 
+// Timing state of the output pattern, carried from one step to the next
+struct OutputPattern {
+    unsigned long lastBlinkTime = 0;
+    unsigned long lastBuzzTime = 0;
+    unsigned long lastBeepTime = 0;
+    bool blinkState = false;
+    bool buzzActive = false;
+    bool beepActive = false;
+    unsigned long buzzStartTime = 0;
+    unsigned long beepStartTime = 0;
+};
+
+// Output levels produced by one pattern step
+struct OutputLevels {
+    bool builtInLed;
+    bool buzzer;
+    bool vibe;
+};
+
 class OuptutClass {
 public:
     // Methods
         void begin();               // Initializes the output module
         void setState(OutputState); // Sets the current output state
+        void setCompartmentCount(uint8_t count); // Adds one WS2812B pixel per compartment after the status pixel
+        void setDueCompartments(uint32_t mask);  // Bit N lights compartment N's pixel (dose due)
+        void setHatchOpen(bool open);             // Shows HATCH_OPEN while the hatch is open (input task, on edges)
+        void setOpenCompartments(uint32_t mask);  // Open compartments, their pixels stay dark (input task, on edges)
+        OutputState getState() { return currentState; }
+        uint32_t getDueCompartments() { return dueCompartments; }
+
+        // Computes the GPIO levels of a state at the given time, without touching the GPIOs
+        static OutputLevels patternStep(OutputState state, unsigned long currentTime, unsigned long buzzDuration, unsigned long beepDuration, OutputPattern& p);
+
+        // Composes the WS2812B frame of a state: status pixel (gauge / breathing) and the due compartments.
+        // stateTime is the time in the state, buzzTime the time since the last buzz started (the breathing peaks there).
+        static void renderFrame(CRGB* frame, OutputState state, uint32_t due, uint8_t compartmentCount,
+                                unsigned long stateTime, unsigned long buzzTime, uint8_t soc);
 
 private:
     // Methods
@@ -38,4 +74,8 @@ private:
 
     // Members
         OutputState currentState;   // Current output state
+        uint8_t compartmentCount = 0;
+        volatile uint32_t dueCompartments = 0;
+        volatile bool hatchOpen = false;
+        volatile uint32_t openCompartments = 0;
 };
\ No newline at end of file
@@ -6,4 +6,9 @@
 #define PIN_WS2812       13
 #define PIN_BUZZER       32
 #define PIN_VIBE         33
-#define PIN_BATTERY_VOLTAGE 35
\ No newline at end of file
+#define PIN_BATTERY_VOLTAGE 35
+
+// I2C GPIO expanders (MCP23017) for the compartment hatches
+#define PIN_I2C_SDA      21
+#define PIN_I2C_SCL      22
+#define PIN_EXPANDER_INT 27 // Shared, open drain INTA/INTB of all expanders (must be an RTC GPIO)
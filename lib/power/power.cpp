@@ -0,0 +1,158 @@
+#include "power.hpp"
+#include <Arduino.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+
+// Governor configuration
+#define POWER_TASK_INTERVAL_MS 1000
+#define VOLTAGE_FILTER_ALPHA 0.1f
+#define DRAIN_RATE_WINDOW_S 1800 // Wall time (including deep sleep) between drain rate samples
+#define DRAIN_RATE_MAX_GAP_S (7 * 24 * 3600) // Larger gaps are clock jumps, not drain
+#define CHARGE_DETECT_SOC 5    // SoC rise that counts as charging and restarts the drain rate tracking
+#define NO_BATTERY_VOLTAGE 2.5f // Below this the divider reads nothing (USB powered), assume a full battery
+#define BOOT_VOLTAGE_SAMPLES 16 // Averaged for the boot decision, one ADC reading is noisier than the tier hysteresis
+
+// Tier table, indexed by PowerTier
+static const PowerPolicy policies[] = {
+    // minSoc, ledBrightness, alertDutyPercent, inputIntervalMs, accessPointEnabled, ntpSyncIntervalS
+    {50, 50, 100, 100,  true,  0},          // NORMAL
+    {25, 30, 100, 200,  true,  6 * 3600},   // SAVING
+    {10, 15, 75,  500,  true,  24 * 3600},  // LOW_BATTERY
+    {0,  5,  50,  1000, false, UINT32_MAX}, // CRITICAL
+};
+static const char* tierNames[] = {"NORMAL", "SAVING", "LOW_BATTERY", "CRITICAL"};
+
+// LiPo resting voltage to state of charge
+static const struct { float voltage; uint8_t soc; } dischargeCurve[] = {
+    {4.20f, 100}, {4.10f, 90}, {4.00f, 78}, {3.90f, 65}, {3.80f, 50}, {3.75f, 40},
+    {3.70f, 30},  {3.65f, 20}, {3.60f, 12}, {3.50f, 5},  {3.30f, 0},
+};
+
+// Drain rate tracking, kept in RTC memory across deep sleep
+RTC_DATA_ATTR static time_t drainRefTime = 0;
+RTC_DATA_ATTR static uint8_t drainRefSoc = 0;
+RTC_DATA_ATTR static float drainPercentPerHour = -1;
+
+// Tier of the last boot, the hysteresis has to start from it or every wakeup near a threshold would flap
+RTC_DATA_ATTR static PowerTier rtcTier = PowerTier::NORMAL;
+
+void PowerClass::begin() {
+    printf("Initializing power governor...\n");
+
+    // Continue from the tier we went to sleep in (RTC memory is reinitialized on power on)
+        if (esp_reset_reason() == ESP_RST_POWERON) rtcTier = PowerTier::NORMAL;
+        currentTier = rtcTier;
+
+    // Take a first sample right away, the AP / NTP decisions at boot depend on it
+        float sum = 0;
+        for (int i = 0; i < BOOT_VOLTAGE_SAMPLES; i++) {
+            sum += InputClass::readBatteryVoltage();
+        }
+        filteredVoltage = sum / BOOT_VOLTAGE_SAMPLES;
+        update(filteredVoltage);
+        printf(" - Battery: %.2f V, %d%%, tier %s\n", filteredVoltage, soc, tierNames[(int)currentTier]);
+
+    xTaskCreate(
+        powerTask,       // Task function
+        "PowerTask",     // Task name
+        2048,            // Stack size (bytes)
+        this,            // Parameter to pass to task
+        1,               // Priority (1 = low)
+        NULL             // Task handle
+    );
+}
+
+const PowerPolicy& PowerClass::policy() {
+    return policies[(int)currentTier];
+}
+
+const PowerPolicy& PowerClass::policyOf(PowerTier tier) {
+    return policies[(int)tier];
+}
+
+float PowerClass::remainingHours() {
+    if (drainPercentPerHour <= 0) return -1;
+    return soc / drainPercentPerHour;
+}
+
+uint8_t PowerClass::voltageToSoc(float voltage) {
+    const int points = sizeof(dischargeCurve) / sizeof(dischargeCurve[0]);
+    if (voltage >= dischargeCurve[0].voltage) return 100;
+    if (voltage <= dischargeCurve[points - 1].voltage) return 0;
+
+    // Linear interpolation between the two surrounding points
+    for (int i = 1; i < points; i++) {
+        if (voltage >= dischargeCurve[i].voltage) {
+            float span = dischargeCurve[i - 1].voltage - dischargeCurve[i].voltage;
+            float t = (voltage - dischargeCurve[i].voltage) / span;
+            return dischargeCurve[i].soc + (uint8_t)(t * (dischargeCurve[i - 1].soc - dischargeCurve[i].soc) + 0.5f);
+        }
+    }
+    return 0;
+}
+
+PowerTier PowerClass::selectTier(PowerTier current, uint8_t soc) {
+    // Drop down right away, but only move back up with some margin
+    PowerTier target = PowerTier::CRITICAL;
+    PowerTier targetUp = PowerTier::CRITICAL;
+    for (int i = (int)PowerTier::CRITICAL; i >= 0; i--) {
+        if (soc >= policies[i].minSoc) target = (PowerTier)i;
+        if (soc >= policies[i].minSoc + CONF_TIER_HYSTERESIS) targetUp = (PowerTier)i;
+    }
+    if (target > current) return target;
+    if (targetUp < current) return targetUp;
+    return current;
+}
+
+void PowerClass::powerTask(void* parameter) {
+    PowerClass* power = static_cast<PowerClass*>(parameter);
+
+    while (true) {
+        power->update(power->input.data.batteryVoltage);
+        vTaskDelay(pdMS_TO_TICKS(POWER_TASK_INTERVAL_MS));
+    }
+}
+
+void PowerClass::update(float voltage) {
+    // Without a battery measurement stay in NORMAL
+        if (voltage < NO_BATTERY_VOLTAGE) {
+            soc = 100;
+            currentTier = rtcTier = PowerTier::NORMAL;
+            return;
+        }
+
+    // Filter the noisy ADC reading
+        if (filteredVoltage < NO_BATTERY_VOLTAGE) filteredVoltage = voltage;
+        filteredVoltage += VOLTAGE_FILTER_ALPHA * (voltage - filteredVoltage);
+        soc = voltageToSoc(filteredVoltage);
+
+    // Select the tier
+        PowerTier newTier = selectTier(currentTier, soc);
+        if (newTier != currentTier) {
+            printf(">>> Power tier changed: %s -> %s (%d%%) <<<\n", tierNames[(int)currentTier], tierNames[(int)newTier], soc);
+            currentTier = rtcTier = newTier;
+        }
+
+    // Track the drain rate (% per hour) over windows long enough to hide the ADC noise
+        time_t now;
+        time(&now);
+        if (drainRefTime == 0 || now < drainRefTime || now - drainRefTime > DRAIN_RATE_MAX_GAP_S ||
+            soc > drainRefSoc + CHARGE_DETECT_SOC) {
+            // First sample, clock was set (NTP) or the battery was charged, start over
+            drainRefTime = now;
+            drainRefSoc = soc;
+        } else if (now - drainRefTime >= DRAIN_RATE_WINDOW_S && soc <= drainRefSoc) {
+            float rate = (drainRefSoc - soc) * 3600.0f / (now - drainRefTime);
+            drainPercentPerHour = drainPercentPerHour < 0 ? rate : drainPercentPerHour * 0.7f + rate * 0.3f;
+            drainRefTime = now;
+            drainRefSoc = soc;
+        }
+}
+
+void PowerClass::exportJson(Print& out) {
+    const PowerPolicy& p = policy();
+    out.printf("{\"batteryVoltage\":%.2f,\"stateOfCharge\":%d,\"tier\":\"%s\",\"remainingHours\":%.1f,"
+               "\"ledBrightness\":%d,\"alertDutyPercent\":%d,\"inputIntervalMs\":%d,\"accessPointEnabled\":%s}",
+        filteredVoltage, soc, tierNames[(int)currentTier], remainingHours(),
+        p.ledBrightness, p.alertDutyPercent, p.inputIntervalMs, p.accessPointEnabled ? "true" : "false");
+}
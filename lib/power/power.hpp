@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <Print.h>
+#include "input.hpp"
+// This module is the power budget governor. It estimates the battery state of charge and scales
+// everything that is not essential down as the battery drains, so dose alerts keep working as long as possible.
+// Table of tiers:
+//  - NORMAL: Everything as usual.
+//  - SAVING: Dimmer LED, slower input sampling, NTP sync at most every 6 hours.
+//  - LOW: Dim LED, shorter buzz / beep pulses, NTP sync at most once a day.
+//  - CRITICAL: Minimal LED, no access point and no NTP sync. Alerts still run (at reduced duty).
+
+enum class PowerTier : uint8_t {
+    NORMAL,
+    SAVING,
+    LOW_BATTERY,
+    CRITICAL
+};
+
+struct PowerPolicy {
+    uint8_t minSoc;              // Lowest state of charge (%) this tier is used for
+    uint8_t ledBrightness;       // WS2812B brightness (0-255)
+    uint8_t alertDutyPercent;    // Buzz / beep pulse length in % of the nominal length
+    uint16_t inputIntervalMs;    // Input sampling interval
+    bool accessPointEnabled;     // Whether the AP and web server may run
+    uint32_t ntpSyncIntervalS;   // Minimum time between NTP sync attempts (0 = every boot, UINT32_MAX = never)
+};
+
+class PowerClass {
+public:
+    // Constructor
+        PowerClass(InputClass& p_input) : input(p_input) {}
+
+    // Methods
+        void begin(); // Restores the tier of the last boot, takes a first battery sample, selects the tier and starts the governor task
+        PowerTier tier() { return currentTier; }
+        const PowerPolicy& policy(); // Policy of the current tier
+        uint8_t stateOfCharge() { return soc; } // Estimated state of charge in %
+        float remainingHours(); // Estimated remaining runtime from the measured drain rate, -1 if not known yet
+        void exportJson(Print& out); // Writes the governor state as JSON
+
+        static uint8_t voltageToSoc(float voltage); // LiPo discharge curve lookup
+        static PowerTier selectTier(PowerTier current, uint8_t soc); // Drops down right away, moves back up with hysteresis
+        static const PowerPolicy& policyOf(PowerTier tier); // Policy of any tier
+
+private:
+    // Methods
+        static void powerTask(void* parameter); // FreeRTOS task function
+        void update(float voltage);             // Filters the voltage and updates SoC, tier and drain rate
+
+    // Attributes
+        volatile PowerTier currentTier = PowerTier::NORMAL;
+        volatile uint8_t soc = 100;
+        float filteredVoltage = 0;
+
+        static const uint8_t CONF_TIER_HYSTERESIS = 3; // SoC (%) needed above a tier threshold before moving back up
+
+    // References to other modules
+        InputClass& input;
+};
@@ -4,6 +4,16 @@
 #include <LittleFS.h>
 #include <output.hpp>
 #include <input.hpp>
+#include <trace.hpp>
+#include <metrics.hpp>
+#include <power.hpp>
+#include <led.hpp>
+#include <journal.hpp>
+#include <bench.hpp>
+#include <cbor.hpp>
+#include <dose_log.hpp>
+#include <sleep_system.hpp>
+#include <esp_attr.h>
 #include "time.h"
 
 // Create WebServer instance on port 80
@@ -12,26 +22,85 @@ WebServer webServer(80);
 // External output instance (declared in main.cpp)
 extern OuptutClass output;
 extern InputClass input;
+extern TraceClass trace;
+extern MetricsClass metrics;
+extern PowerClass power;
+extern LedClass led;
+extern JournalClass journal;
+#ifdef BENCH_ENABLED
+extern BenchClass bench;
+#endif
+extern DoseLogClass doseLog;
+extern SleepSystemClass sleepSystem;
 
 const char* ntpServer = "pool.ntp.org";
-const char* timezone = "CET-1CEST-2,M3.5.0/02:00:00,M10.5.0/03:00:00";
+const char* timezoneRule = "CET-1CEST-2,M3.5.0/02:00:00,M10.5.0/03:00:00";
+
+// Bulk transfer limits
+#define SCHEDULE_CHUNK_MAX_BYTES 1024 // Largest accepted schedule upload chunk (request body)
+#define LOG_PAGE_MAX_ENTRIES 1024     // Largest dose log page per request
+#define LOG_READ_BLOCK 32             // Dose log entries read from flash at a time
+
+// Schedule upload state: the body of the current request and the entries received so far
+static uint8_t uploadBody[SCHEDULE_CHUNK_MAX_BYTES + 1]; // Room for a terminator, JSON is parsed as a string
+static size_t uploadLength = 0;
+static bool uploadOverflow = false;
+static WakeTimestamp stagedSchedule[MAX_SCHEDULE_ENTRIES];
+static uint8_t stagedCount = 0;
+static uint8_t stagedTotal = 0;
+
+// Times of the last successful NTP sync and of the last attempt, kept in RTC memory across deep sleep
+RTC_DATA_ATTR static time_t lastNtpSync = 0;
+RTC_DATA_ATTR static time_t lastNtpAttempt = NTP_NEVER_ATTEMPTED;
+
+// Buffers Print output and sends it as chunks of a chunked HTTP response
+class ChunkedResponse : public Print {
+public:
+    size_t write(uint8_t c) override {
+        buffer[length++] = c;
+        if (length == sizeof(buffer)) flush();
+        return 1;
+    }
+    void flush() override {
+        if (length > 0) {
+            webServer.sendContent(buffer, length);
+            length = 0;
+        }
+    }
+
+private:
+    char buffer[512];
+    size_t length = 0;
+};
 
 void ServerClass::begin() {
     printf("Starting server...\n");
 
-    // Initialize LittleFS
-    if (!LittleFS.begin(true)) {
-        printf(" - Failed to mount LittleFS!\n");
-        return;
-    }
-    printf(" - LittleFS mounted successfully\n");
-    
-    // Try to sync time with NTP first
-    printf(" - Attempting NTP time sync...\n");
-    if (syncTimeWithNTP()) {
-        printf(" - Time synced successfully!\n");
+    // Try to sync time with NTP first, as often as the power tier allows
+    const PowerPolicy& policy = power.policy();
+    time_t now;
+    time(&now);
+
+    if (ntpSyncDue(policy, now, lastNtpAttempt)) {
+        printf(" - Attempting NTP time sync...\n");
+        if (syncTimeWithNTP()) {
+            printf(" - Time synced successfully!\n");
+        } else {
+            printf(" - NTP sync failed, continuing without network time\n");
+        }
+        time(&lastNtpAttempt); // After the attempt, a successful sync moves the clock
     } else {
-        printf(" - NTP sync failed, continuing without network time\n");
+        // The RTC kept the time through deep sleep, only the timezone has to be restored
+        printf(" - Skipping NTP sync (power saving), last attempt %ld s ago\n", (long)(now - lastNtpAttempt));
+        setenv("TZ", timezoneRule, 1);
+        tzset();
+        timeSynced = lastNtpSync != 0;
+    }
+
+    // No access point on a critical battery, the alerts need the energy more
+    if (!policy.accessPointEnabled) {
+        printf(" - Access Point disabled by power governor\n");
+        return;
     }
     
     printf(" - Starting Access Point...\n");
@@ -39,6 +108,7 @@ void ServerClass::begin() {
     // Start WiFi in AP+STA mode (allows both AP and Station simultaneously)
     WiFi.mode(WIFI_AP_STA);
     WiFi.softAP(AP_SSID, AP_PASSWORD);
+    accessPointRunning = true;
     
     // Print IP address
     IPAddress IP = WiFi.softAPIP();
@@ -47,15 +117,32 @@ void ServerClass::begin() {
     printf(" - Password: %s\n", AP_PASSWORD);
     
     // Setup server routes
-    webServer.on("/", [this](){ this->handleRoot(); });
-    webServer.on("/state/off", [this](){ this->handleState(); });
-    webServer.on("/state/on", [this](){ this->handleState(); });
-    webServer.on("/state/hatch", [this](){ this->handleState(); });
-    webServer.on("/state/phase1", [this](){ this->handleState(); });
-    webServer.on("/state/phase2", [this](){ this->handleState(); });
-    webServer.on("/state/phase3", [this](){ this->handleState(); });
-    webServer.on("/state/phase4", [this](){ this->handleState(); });
-    webServer.on("/input", [this](){ this->handleInput(); });
+    webServer.on("/", [this](){ this->traced(ServerRoute::ROOT, &ServerClass::handleRoot); });
+    webServer.on("/state/off", [this](){ this->traced(ServerRoute::STATE, &ServerClass::handleState); });
+    webServer.on("/state/on", [this](){ this->traced(ServerRoute::STATE, &ServerClass::handleState); });
+    webServer.on("/state/hatch", [this](){ this->traced(ServerRoute::STATE, &ServerClass::handleState); });
+    webServer.on("/state/phase1", [this](){ this->traced(ServerRoute::STATE, &ServerClass::handleState); });
+    webServer.on("/state/phase2", [this](){ this->traced(ServerRoute::STATE, &ServerClass::handleState); });
+    webServer.on("/state/phase3", [this](){ this->traced(ServerRoute::STATE, &ServerClass::handleState); });
+    webServer.on("/state/phase4", [this](){ this->traced(ServerRoute::STATE, &ServerClass::handleState); });
+    webServer.on("/input", [this](){ this->traced(ServerRoute::INPUT_DATA, &ServerClass::handleInput); });
+    webServer.on("/trace", [this](){ this->traced(ServerRoute::TRACE, &ServerClass::handleTrace); });
+    webServer.on("/metrics", [this](){ this->traced(ServerRoute::METRICS, &ServerClass::handleMetrics); });
+    webServer.on("/power", [this](){ this->traced(ServerRoute::POWER, &ServerClass::handlePower); });
+    #ifdef BENCH_ENABLED
+        webServer.on("/bench", [this](){ this->traced(ServerRoute::BENCH, &ServerClass::handleBench); });
+    #endif
+    webServer.on("/schedule", HTTP_GET, [this](){ this->traced(ServerRoute::SCHEDULE, &ServerClass::handleScheduleGet); });
+    webServer.on("/schedule", HTTP_POST,
+        [this](){ this->traced(ServerRoute::SCHEDULE, &ServerClass::handleScheduleUpload); },
+        [this](){ this->handleScheduleUploadBody(); });
+    webServer.on("/log", [this](){ this->traced(ServerRoute::LOG, &ServerClass::handleLog); });
+    webServer.on("/leds", [this](){ this->traced(ServerRoute::LEDS, &ServerClass::handleLeds); });
+    webServer.on("/journal", [this](){ this->traced(ServerRoute::JOURNAL, &ServerClass::handleJournal); });
+
+    // The bulk transfer routes negotiate CBOR through the Accept header
+    const char* headerKeys[] = {"Accept", "Content-Type"};
+    webServer.collectHeaders(headerKeys, 2);
     
     // Start server
     webServer.begin();
@@ -73,6 +160,13 @@ void ServerClass::begin() {
     printf(" - Server task created!\n");
 }
 
+bool ServerClass::ntpSyncDue(const PowerPolicy& policy, time_t now, time_t lastAttempt) {
+    if (policy.ntpSyncIntervalS == UINT32_MAX) return false; // Never in this tier, not even without a sync since power on
+    if (policy.ntpSyncIntervalS == 0 || lastAttempt == NTP_NEVER_ATTEMPTED) return true;
+    if (now < lastAttempt) return true; // The clock was set back
+    return now - lastAttempt >= (time_t)policy.ntpSyncIntervalS; // Failed attempts count too, no retry on every boot
+}
+
 bool ServerClass::tryConnectToKnownNetworks() {
     printf(" - Scanning for known networks...\n");
     
@@ -145,8 +239,8 @@ bool ServerClass::syncTimeWithNTP() {
     }
 
     // NOW set timezone AFTER time is synced
-    printf(" - Setting timezone to: %s\n", timezone);
-    setenv("TZ", timezone, 1);
+    printf(" - Setting timezone to: %s\n", timezoneRule);
+    setenv("TZ", timezoneRule, 1);
     tzset();
     
     // Get time again with proper timezone
@@ -164,6 +258,7 @@ bool ServerClass::syncTimeWithNTP() {
     printf(" - Timezone env var: %s\n", getenv("TZ"));
 
     timeSynced = true;
+    time(&lastNtpSync);
     WiFi.disconnect(true);
     printf(" - Disconnected from WiFi (AP remains active)\n");
 
@@ -181,30 +276,76 @@ void ServerClass::serverTask(void* parameter) {
 }
 
 void ServerClass::worker() {
+    // Shut the AP down if the battery became critical
+    if (accessPointRunning && !power.policy().accessPointEnabled) {
+        printf(" - Access Point disabled by power governor\n");
+        WiFi.softAPdisconnect(true);
+        WiFi.mode(WIFI_OFF);
+        accessPointRunning = false;
+    }
+
     // Handle client requests
     webServer.handleClient();
 }
 
+void ServerClass::traced(ServerRoute route, void (ServerClass::*handler)()) {
+    trace.record(TraceTask::SERVER_TASK, TraceEvent::REQUEST_BEGIN, (uint32_t)route);
+    metrics.start(LatencyPath::HTTP_REQUEST);
+    (this->*handler)();
+    metrics.stop(LatencyPath::HTTP_REQUEST);
+    trace.record(TraceTask::SERVER_TASK, TraceEvent::REQUEST_END, (uint32_t)route);
+}
+
+void ServerClass::sendStreamed(int code, const char* type, std::function<void(Print&)> writeBody) {
+    // The body is sent as it is written, so large responses never have to fit in the heap
+    webServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    webServer.send(code, type, "");
+
+    ChunkedResponse response;
+    writeBody(response);
+    response.flush();
+    webServer.sendContent(""); // Terminates the chunked response
+}
+
 void ServerClass::handleRoot() {
-    // Try to open the HTML file from LittleFS
-    File file = LittleFS.open("/index.html", "r");
-    if (!file) {
+    // Read and send the page
+    String html;
+    if (!readRootPage(html)) {
         printf("Failed to open index.html\n");
         webServer.send(500, "text/plain", "Failed to load page");
         return;
     }
-    
-    // Read and send the file
-    String html = file.readString();
-    file.close();
     webServer.send(200, "text/html", html);
 }
 
+bool ServerClass::readRootPage(String& html) {
+    // Try to open the HTML file from LittleFS
+    File file = LittleFS.open("/index.html", "r");
+    if (!file) {
+        return false;
+    }
+
+    html = file.readString();
+    file.close();
+    return true;
+}
+
 void ServerClass::handleState() {
-    String uri = webServer.uri();
     OutputState newState;
     String stateName;
+    if (!parseStateUri(webServer.uri(), newState, stateName)) {
+        webServer.send(400, "text/plain", "Invalid state");
+        return;
+    }
     
+    // Set the output state
+    output.setState(newState);
+    
+    printf(">>> State changed to: %s <<<\n", stateName.c_str());
+    webServer.send(200, "text/plain", "State: " + stateName);
+}
+
+bool ServerClass::parseStateUri(const String& uri, OutputState& newState, String& stateName) {
     if (uri == "/state/off") {
         newState = OutputState::OFF;
         stateName = "OFF";
@@ -227,18 +368,16 @@ void ServerClass::handleState() {
         newState = OutputState::NOTIFICATION_PHASE_4;
         stateName = "NOTIFICATION_PHASE_4";
     } else {
-        webServer.send(400, "text/plain", "Invalid state");
-        return;
+        return false;
     }
-    
-    // Set the output state
-    output.setState(newState);
-    
-    printf(">>> State changed to: %s <<<\n", stateName.c_str());
-    webServer.send(200, "text/plain", "State: " + stateName);
+    return true;
 }
 
 void ServerClass::handleInput() {
+    webServer.send(200, "application/json", inputJson());
+}
+
+String ServerClass::inputJson() {
     // Create JSON response with input data
     String json = "{";
     json += "\"isHatchOpen\":";
@@ -247,7 +386,290 @@ void ServerClass::handleInput() {
     json += input.data.isUserSwitchPressed ? "true" : "false";
     json += ",\"batteryVoltage\":";
     json += String(input.data.batteryVoltage, 2);
+    json += ",\"compartmentCount\":";
+    json += String(input.data.compartmentCount);
+    json += ",\"openCompartments\":";
+    json += String(input.data.openCompartments);
+    json += ",\"expanderScanUs\":";
+    json += String(input.expander.lastScanUs);
+    json += ",\"expanderMaxScanUs\":";
+    json += String(input.expander.maxScanUs);
     json += "}";
-    
-    webServer.send(200, "application/json", json);
+    return json;
+}
+
+void ServerClass::handleTrace() {
+    // Stream the trace, the whole JSON document would not fit in the heap
+    webServer.sendHeader("Content-Disposition", "attachment; filename=\"trace.json\"");
+    sendStreamed(200, "application/json", [](Print& out) { trace.exportChromeJson(out); });
+}
+
+void ServerClass::handleMetrics() {
+    sendStreamed(200, "application/json", [](Print& out) { metrics.exportJson(out); });
+}
+
+void ServerClass::handlePower() {
+    sendStreamed(200, "application/json", [](Print& out) { power.exportJson(out); });
+}
+
+void ServerClass::handleLeds() {
+    sendStreamed(200, "application/json", [](Print& out) { led.exportJson(out); });
+}
+
+void ServerClass::handleJournal() {
+    #ifdef JOURNAL_FAULT_INJECTION
+        // The device resets at the given journal write point, the next boot checks the recovered state
+        if (webServer.hasArg("crashAt")) {
+            journal.armFault(webServer.arg("crashAt").toInt());
+        }
+    #endif
+
+    sendStreamed(200, "application/json", [](Print& out) { journal.exportJson(out); });
+}
+
+#ifdef BENCH_ENABLED
+void ServerClass::handleBench() {
+    // Run first, the status code tells scripts whether a benchmark regressed
+    bool pass = bench.run();
+    sendStreamed(pass ? 200 : 500, "application/json", [](Print& out) { bench.exportJson(out); });
+}
+#endif
+
+bool ServerClass::wantsCbor() {
+    return webServer.header("Accept").indexOf(CBOR_CONTENT_TYPE) >= 0;
+}
+
+void ServerClass::handleScheduleGet() {
+    bool cbor = wantsCbor();
+    uint8_t count = sleepSystem.getScheduleCount();
+
+    sendStreamed(200, cbor ? CBOR_CONTENT_TYPE : "application/json", [&](Print& out) {
+        // Array of [hour, minute, compartment, weekdays]
+        CborWriter writer(out);
+        if (cbor) writer.beginArray(count);
+        else out.print("[");
+        for (uint8_t i = 0; i < count; i++) {
+            WakeTimestamp entry = sleepSystem.getScheduleEntry(i);
+            if (cbor) {
+                writer.beginArray(4);
+                writer.writeUint(entry.hour);
+                writer.writeUint(entry.minute);
+                writer.writeUint(entry.compartment);
+                writer.writeUint(entry.weekdays);
+            } else {
+                out.printf("%s[%d,%d,%d,%d]", i == 0 ? "" : ",", entry.hour, entry.minute, entry.compartment, entry.weekdays);
+            }
+        }
+        if (!cbor) out.print("]");
+    });
+}
+
+void ServerClass::handleScheduleUploadBody() {
+    // Collects the raw request body into the fixed upload buffer
+    HTTPRaw& raw = webServer.raw();
+    if (raw.status == RAW_START || raw.status == RAW_ABORTED) {
+        uploadLength = 0;
+        uploadOverflow = false;
+    } else if (raw.status == RAW_WRITE) {
+        if (uploadLength + raw.currentSize > SCHEDULE_CHUNK_MAX_BYTES) {
+            uploadOverflow = true;
+        } else {
+            memcpy(uploadBody + uploadLength, raw.buf, raw.currentSize);
+            uploadLength += raw.currentSize;
+        }
+    }
+}
+
+void ServerClass::handleScheduleUpload() {
+    int code = stageScheduleChunk();
+
+    // The body belongs to this request only, a later request without one must not stage it again
+    uploadLength = 0;
+    uploadOverflow = false;
+
+    sendUploadStatus(code);
+}
+
+int ServerClass::stageScheduleChunk() {
+    // POST /schedule?offset=N&total=T with an array of [hour, minute, compartment, weekdays] as body,
+    // CBOR (Content-Type: application/cbor) or JSON (application/json).
+    // weekdays is a mask, bit N = tm_wday N (0 = Sunday), entries without it are taken every day.
+    // Chunks must arrive in order, offset=0 (re)starts an upload. The schedule is replaced once all T entries arrived.
+    uint32_t offset = webServer.arg("offset").toInt();
+    uint32_t total = webServer.arg("total").toInt();
+    String type = webServer.header("Content-Type");
+    bool cbor = type.startsWith(CBOR_CONTENT_TYPE);
+
+    if (!cbor && !type.startsWith("application/json")) return 415;
+    if (uploadOverflow) return 413;
+    if (total == 0 || total > MAX_SCHEDULE_ENTRIES) return 400;
+    if (offset == 0) {
+        stagedCount = 0;
+        stagedTotal = total;
+    }
+    if (offset != stagedCount || total != stagedTotal) return 409; // Tells the client where to resume
+
+    // Decode the chunk, nothing is staged unless all of it is valid
+    WakeTimestamp entries[MAX_SCHEDULE_ENTRIES];
+    uint32_t count = 0;
+    uint32_t room = stagedTotal - stagedCount;
+    uploadBody[uploadLength] = '\0';
+    bool valid = cbor ? decodeCborSchedule(uploadBody, uploadLength, entries, room, count)
+                      : decodeJsonSchedule((const char*)uploadBody, uploadLength, entries, room, count);
+    if (!valid) return 400;
+
+    memcpy(stagedSchedule + stagedCount, entries, count * sizeof(WakeTimestamp));
+    stagedCount += count;
+
+    // Last chunk, replace the schedule
+    if (stagedCount == stagedTotal && !sleepSystem.setSchedule(stagedSchedule, stagedCount)) return 500;
+    return 200;
+}
+
+bool ServerClass::makeScheduleEntry(const uint32_t* fields, uint32_t count, WakeTimestamp& entry) {
+    // [hour, minute, compartment] or [hour, minute, compartment, weekdays]
+    uint32_t weekdays = count == 4 ? fields[3] : WEEKDAYS_ALL;
+    if ((count != 3 && count != 4) || fields[0] >= 24 || fields[1] >= 60 || fields[2] >= 32 ||
+        weekdays == 0 || weekdays > WEEKDAYS_ALL) return false;
+
+    entry = {(uint8_t)fields[0], (uint8_t)fields[1], (uint8_t)fields[2], (uint8_t)weekdays};
+    return true;
+}
+
+bool ServerClass::decodeCborSchedule(const uint8_t* body, size_t length, WakeTimestamp* entries, uint32_t room, uint32_t& count) {
+    CborReader reader(body, length);
+    if (!reader.readArray(count) || count > room) return false; // Count is untrusted, no sums
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t fields[4];
+        uint32_t fieldCount;
+        if (!reader.readArray(fieldCount) || fieldCount > 4) return false;
+        for (uint32_t f = 0; f < fieldCount; f++) {
+            if (!reader.readUint(fields[f])) return false;
+        }
+        if (!makeScheduleEntry(fields, fieldCount, entries[i])) return false;
+    }
+    return reader.atEnd();
+}
+
+// JSON tokens, whitespace is skipped before each one
+static const char* jsonSkipSpace(const char* p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    return p;
+}
+
+static bool jsonTake(const char*& p, char c) {
+    p = jsonSkipSpace(p);
+    if (*p != c) return false;
+    p++;
+    return true;
+}
+
+static bool jsonUint(const char*& p, uint32_t& value) {
+    p = jsonSkipSpace(p);
+    if (*p < '0' || *p > '9') return false;
+    char* end;
+    unsigned long parsed = strtoul(p, &end, 10);
+    value = parsed > UINT32_MAX ? UINT32_MAX : parsed; // Out of range either way
+    p = end;
+    return true;
+}
+
+bool ServerClass::decodeJsonSchedule(const char* body, size_t length, WakeTimestamp* entries, uint32_t room, uint32_t& count) {
+    const char* p = body;
+    count = 0;
+    if (!jsonTake(p, '[')) return false;
+
+    if (!jsonTake(p, ']')) {
+        do {
+            uint32_t fields[4];
+            uint32_t fieldCount = 0;
+            if (count == room || !jsonTake(p, '[')) return false;
+            do {
+                if (fieldCount == 4 || !jsonUint(p, fields[fieldCount++])) return false;
+            } while (jsonTake(p, ','));
+            if (!jsonTake(p, ']') || !makeScheduleEntry(fields, fieldCount, entries[count])) return false;
+            count++;
+        } while (jsonTake(p, ','));
+        if (!jsonTake(p, ']')) return false;
+    }
+
+    return jsonSkipSpace(p) == body + length; // Nothing after the array (a NUL inside the body stops short of it)
+}
+
+void ServerClass::sendUploadStatus(int code) {
+    bool committed = code == 200 && stagedCount == stagedTotal;
+
+    bool cbor = wantsCbor();
+    sendStreamed(code, cbor ? CBOR_CONTENT_TYPE : "application/json", [&](Print& out) {
+        if (cbor) {
+            CborWriter writer(out);
+            writer.beginMap(3);
+            writer.writeString("next");
+            writer.writeUint(stagedCount);
+            writer.writeString("total");
+            writer.writeUint(stagedTotal);
+            writer.writeString("committed");
+            writer.writeBool(committed);
+        } else {
+            out.printf("{\"next\":%d,\"total\":%d,\"committed\":%s}", stagedCount, stagedTotal, committed ? "true" : "false");
+        }
+    });
+}
+
+void ServerClass::handleLog() {
+    // GET /log?from=S&count=N, pages through the dose log by sequence number.
+    // The response carries the sequence number to continue from ("next").
+    bool cbor = wantsCbor();
+    uint32_t from = webServer.hasArg("from") ? webServer.arg("from").toInt() : 0;
+    uint32_t count = webServer.hasArg("count") ? webServer.arg("count").toInt() : LOG_PAGE_MAX_ENTRIES;
+    if (count > LOG_PAGE_MAX_ENTRIES) count = LOG_PAGE_MAX_ENTRIES;
+    if (from < doseLog.firstSequence()) from = doseLog.firstSequence();
+
+    sendStreamed(200, cbor ? CBOR_CONTENT_TYPE : "application/json", [&](Print& out) {
+        CborWriter writer(out);
+        if (cbor) {
+            writer.beginMap(3);
+            writer.writeString("from");
+            writer.writeUint(from);
+            writer.writeString("entries");
+            writer.beginIndefiniteArray();
+        } else {
+            out.printf("{\"from\":%u,\"entries\":[", (unsigned)from);
+        }
+
+        // Stream the entries in small blocks, memory use does not depend on the page size
+        DoseLogEntry block[LOG_READ_BLOCK];
+        uint32_t sent = 0;
+        while (sent < count) {
+            uint32_t wanted = count - sent < LOG_READ_BLOCK ? count - sent : LOG_READ_BLOCK;
+            uint32_t read = doseLog.read(from + sent, block, wanted);
+            for (uint32_t i = 0; i < read; i++) {
+                writeLogEntry(out, block[i], cbor, sent + i == 0);
+            }
+            sent += read;
+            if (read < wanted) break;
+        }
+
+        if (cbor) {
+            writer.end();
+            writer.writeString("next");
+            writer.writeUint(from + sent);
+        } else {
+            out.printf("],\"next\":%u}", (unsigned)(from + sent));
+        }
+    });
+}
+
+void ServerClass::writeLogEntry(Print& out, const DoseLogEntry& entry, bool cbor, bool first) {
+    // [time, event, compartment]
+    if (cbor) {
+        CborWriter writer(out);
+        writer.beginArray(3);
+        writer.writeUint(entry.time);
+        writer.writeUint(entry.event);
+        writer.writeUint(entry.compartment);
+    } else {
+        out.printf("%s[%u,%d,%d]", first ? "" : ",", (unsigned)entry.time, entry.event, entry.compartment);
+    }
 }
\ No newline at end of file
@@ -1,6 +1,33 @@
 #pragma once
 #include <vector>
+#include <functional>
 #include <string>
+#include <stdint.h>
+#include <time.h>
+#include <WString.h>
+#include <output.hpp>
+#include <Print.h>
+#include <dose_log.hpp>
+#include <power.hpp>
+
+#define NTP_NEVER_ATTEMPTED ((time_t)-1)
+
+struct WakeTimestamp; // Schedule entry, see sleep_system
+
+// Route ids, used as payload of the request trace events
+enum class ServerRoute : uint8_t {
+    ROOT,
+    STATE,
+    INPUT_DATA,
+    TRACE,
+    METRICS,
+    POWER,
+    BENCH,
+    SCHEDULE,
+    LOG,
+    LEDS,
+    JOURNAL
+};
 
 struct WiFiNetwork {
     const char* ssid;
@@ -13,6 +40,18 @@ public:
         void begin(); // Starts the AP, server, and FreeRTOS task
         bool syncTimeWithNTP(); // Attempts to connect to WiFi and sync time
         bool isTimeSynced() { return timeSynced; }
+        static bool ntpSyncDue(const PowerPolicy& policy, time_t now, time_t lastAttempt); // Whether the tier allows an NTP attempt now
+
+        // Request processing without the transport (also used by the benchmarks and tests)
+        bool readRootPage(String& html); // Loads index.html from LittleFS
+        static bool parseStateUri(const String& uri, OutputState& newState, String& stateName); // Maps /state/... to a state
+        String inputJson(); // Serializes the input data
+        static void writeLogEntry(Print& out, const DoseLogEntry& entry, bool cbor, bool first); // Encodes one dose log entry
+
+        // Decode a schedule upload chunk into at most room entries, false if anything in it is invalid
+        static bool decodeCborSchedule(const uint8_t* body, size_t length, WakeTimestamp* entries, uint32_t room, uint32_t& count);
+        static bool decodeJsonSchedule(const char* body, size_t length, WakeTimestamp* entries, uint32_t room, uint32_t& count); // body is terminated
+        static bool makeScheduleEntry(const uint32_t* fields, uint32_t count, WakeTimestamp& entry); // Validates the fields
 
 private:
     // Methods
@@ -22,11 +61,31 @@ private:
         void handleRoot();  // Handles root URL
         void handleState(); // Handles state change requests
         void handleInput(); // Handles input data requests
+        void handleTrace(); // Handles trace dump requests (Chrome trace JSON)
+        void handleMetrics(); // Handles latency histogram requests
+        void handlePower();   // Handles power governor state requests
+    #ifdef BENCH_ENABLED
+        void handleBench();   // Runs the benchmarks (500 if any regressed against the baseline), bench builds only
+    #endif
+        void handleScheduleGet();        // Returns the schedule (CBOR or JSON)
+        void handleScheduleUpload();     // Stages a chunk of a schedule upload, replaces the schedule after the last one
+        int stageScheduleChunk();        // Does the work of handleScheduleUpload, returns the status code
+        void handleScheduleUploadBody(); // Collects the raw body of a schedule upload chunk
+        void handleLog();                // Returns a page of the dose log (CBOR or JSON)
+        void handleLeds();               // Returns the WS2812B frame counters
+        void handleJournal();            // Returns the state journal (?crashAt=N arms a fault in fault injection builds)
+
+        bool wantsCbor(); // True if the client accepts application/cbor
+        void sendStreamed(int code, const char* type, std::function<void(Print&)> writeBody); // Sends a chunked response written by writeBody
+        void sendUploadStatus(int code); // Answers a schedule upload chunk with the next expected offset
+
+        void traced(ServerRoute route, void (ServerClass::*handler)()); // Runs a handler between request begin / end trace events
         
         bool tryConnectToKnownNetworks(); // Try to connect to known WiFi networks
 
     // Attributes
         bool timeSynced = false;
+        bool accessPointRunning = false;
         
     // Known WiFi networks (priority order)
         const std::vector<WiFiNetwork> knownNetworks = {
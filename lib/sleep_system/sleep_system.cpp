@@ -1,8 +1,75 @@
 #include "sleep_system.hpp"
 #include <Arduino.h>
+#include <trace.hpp>
+#include <metrics.hpp>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <LittleFS.h>
+#include <dose_log.hpp>
+#include <journal.hpp>
+
+#define SCHEDULE_PATH "/schedule.bin"
+#define SCHEDULE_FILE_VERSION 0xA2 // Above MAX_SCHEDULE_ENTRIES, so it can't be the count of a version 1 file
+#define SCHEDULE_V1_ENTRY_SIZE 3   // hour, minute, compartment
+static_assert(SCHEDULE_FILE_VERSION > MAX_SCHEDULE_ENTRIES, "Schedule file version must not look like a version 1 count");
+static_assert(sizeof(WakeTimestamp) == 4, "The schedule file stores raw WakeTimestamp entries");
+
+extern TraceClass trace;
+extern MetricsClass metrics;
+extern DoseLogClass doseLog;
+extern JournalClass journal;
+
+// Guards the schedule, it is replaced from the server task
+static portMUX_TYPE scheduleMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Scheduled wakeup time and the compartments due then, kept in RTC memory across deep sleep
+RTC_DATA_ATTR static time_t scheduledWakeup = 0;
+RTC_DATA_ATTR static uint32_t scheduledCompartments = 0;
 
 // Public
     void SleepSystemClass::begin() {
+        // Load the uploaded schedule
+            loadSchedule();
+
+        // Continue where we left off: doses not taken yet stay due, after a reset the alert and the countdown continue too
+            const JournalState& saved = journal.state();
+            dueCompartments = saved.dueCompartments;
+            sleepCounter = saved.sleepCounter;
+            alertPhase = OutputState::ON;
+            alertSeconds = 0;
+            alertExpired = false;
+            if ((OutputState)saved.outputState != OutputState::OFF) {
+                printf("Resuming output state %u\n", (unsigned)saved.outputState);
+                output.setState((OutputState)saved.outputState);
+                if ((OutputState)saved.outputState >= OutputState::NOTIFICATION_PHASE_1) {
+                    alertPhase = (OutputState)saved.outputState;
+                }
+            } else {
+                output.setState(OutputState::ON); // Awake
+            }
+
+        // If a scheduled dose woke us up, the alert latency counts from its due time
+            if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER && scheduledWakeup != 0) {
+                struct timeval now;
+                gettimeofday(&now, nullptr);
+                int64_t lateUs = ((int64_t)now.tv_sec - scheduledWakeup) * 1000000 + now.tv_usec;
+                metrics.startAt(LatencyPath::DUE_TO_ALERT, esp_timer_get_time() - lateUs);
+
+                dueCompartments |= scheduledCompartments;
+                journal.record(JournalField::DUE_COMPARTMENTS, dueCompartments);
+
+                // Log the doses that came due (the single hatch has no compartment id)
+                bool singleHatch = input.data.compartmentCount == 0;
+                if(scheduledCompartments == 0) {
+                    doseLog.append(DoseEvent::DUE);
+                }
+                for(uint8_t i = 0; i < 32; i++) {
+                    if((scheduledCompartments >> i) & 1) doseLog.append(DoseEvent::DUE, singleHatch ? DOSE_LOG_NO_COMPARTMENT : i);
+                }
+            }
+            output.setDueCompartments(dueCompartments);
+            updateAlert(); // Alert right away, not a second later
+
         // Create the sleep system task
             xTaskCreate(
                 sleepSystemTask,          // Task function
@@ -20,27 +87,196 @@
 
         // Main loop for the sleep system task
             while (true) {
-                // If the hatch is closed for X seconds, enter deep sleep
-                    static int hatchClosedCounter = 0;
-                    if(!sleepSystem->input.data.isHatchOpen) {
-                        hatchClosedCounter++;
-                        printf("Hatch closed for %d seconds\n", hatchClosedCounter);
-                        if(hatchClosedCounter >= sleepSystem->CONF_SLEEP_DELAY_HATCH_CLOSED_S) {
-                            printf("Hatch closed for %d seconds, entering deep sleep...\n", sleepSystem->CONF_SLEEP_DELAY_HATCH_CLOSED_S);
-                            sleepSystem->enterDeepSleep();
-                            hatchClosedCounter = 0; // Reset counter after waking up
-                        }
-                    } else {
-                        hatchClosedCounter = 0; // Reset counter if hatch is open
-                    }
-
+                sleepSystem->step();
 
                 // Delay
                     vTaskDelay(pdMS_TO_TICKS(1000));
             }
     }
+    void SleepSystemClass::step() {
+        // Opening a due compartment takes the dose, in single hatch mode opening the main hatch does
+            bool singleHatch = input.data.compartmentCount == 0;
+            uint32_t open = input.data.openCompartments;
+            if(singleHatch) open = input.data.isHatchOpen ? 1UL << SINGLE_HATCH_COMPARTMENT : 0;
+
+            uint32_t taken = dueCompartments & open;
+            if(taken) {
+                dueCompartments &= ~taken;
+                output.setDueCompartments(dueCompartments);
+                journal.record(JournalField::DUE_COMPARTMENTS, dueCompartments);
+                for(uint8_t i = 0; i < 32; i++) {
+                    if((taken >> i) & 1) doseLog.append(DoseEvent::TAKEN, singleHatch ? DOSE_LOG_NO_COMPARTMENT : i);
+                }
+            }
+
+        // Log main hatch openings
+            static bool wasHatchOpen = false;
+            if(input.data.isHatchOpen && !wasHatchOpen) {
+                doseLog.append(DoseEvent::HATCH_OPENED);
+            }
+            wasHatchOpen = input.data.isHatchOpen;
+
+        // Alert while doses are due
+            updateAlert();
+
+        // Make the durable state survive power loss (only written when it changed)
+            journal.checkpoint();
+
+        // If the hatch is closed for X seconds (and no alert is running), enter deep sleep
+            bool isAnythingOpen = input.data.isHatchOpen || input.data.openCompartments != 0;
+            if(!isAnythingOpen && alertPhase == OutputState::ON) {
+                if(sleepCounter == 0) {
+                    trace.record(TraceTask::SLEEP_SYSTEM, TraceEvent::SLEEP_COUNTDOWN, CONF_SLEEP_DELAY_HATCH_CLOSED_S);
+                }
+                sleepCounter++;
+                journal.record(JournalField::SLEEP_COUNTER, sleepCounter);
+                printf("Hatch closed for %d seconds\n", sleepCounter);
+                if(sleepCounter >= CONF_SLEEP_DELAY_HATCH_CLOSED_S) {
+                    printf("Hatch closed for %d seconds, entering deep sleep...\n", CONF_SLEEP_DELAY_HATCH_CLOSED_S);
+                    enterDeepSleep();
+                    sleepCounter = 0; // Reset counter after waking up
+                }
+            } else if(sleepCounter != 0) {
+                sleepCounter = 0; // Reset counter if hatch is open or an alert runs
+                journal.record(JournalField::SLEEP_COUNTER, 0);
+            }
+    }
+
+    time_t SleepSystemClass::nextWakeup(struct tm currentTime, uint32_t& compartments) {
+        portENTER_CRITICAL(&scheduleMux);
+        WakeTimestamp schedules[MAX_SCHEDULE_ENTRIES];
+        uint8_t count = scheduleCount;
+        memcpy(schedules, MedicationSchedule, count * sizeof(WakeTimestamp));
+        portEXIT_CRITICAL(&scheduleMux);
+
+        return nextWakeupOf(schedules, count, input.data.compartmentCount, currentTime, compartments);
+    }
+
+    time_t SleepSystemClass::nextWakeupOf(const WakeTimestamp* schedules, uint8_t count, uint8_t compartmentCount,
+                                          struct tm currentTime, uint32_t& compartments) {
+        time_t now = mktime(&currentTime);
+        time_t earliestWakeup = now + 8 * 24 * 3600; // Every dose is at most a week ahead, only reached without any
+        compartments = 0;
+
+        for(uint8_t i = 0; i < count; i++) {
+            const WakeTimestamp& schedule = schedules[i];
+
+            // First day from today on that is one of the dose's weekdays and still ahead (today's time may have passed)
+            time_t scheduledTime = 0;
+            for(int day = 0; day <= 7 && scheduledTime == 0; day++) {
+                if(!((schedule.weekdays >> ((currentTime.tm_wday + day) % 7)) & 1)) continue;
+
+                struct tm wakeTime = currentTime;
+                wakeTime.tm_mday += day; // mktime normalizes the date
+                wakeTime.tm_hour = schedule.hour;
+                wakeTime.tm_min = schedule.minute;
+                wakeTime.tm_sec = 0;
+                wakeTime.tm_isdst = -1;
+                time_t candidate = mktime(&wakeTime);
+                if(candidate > now) scheduledTime = candidate;
+            }
+            if(scheduledTime == 0) continue; // No weekdays
+
+            if(scheduledTime < earliestWakeup) {
+                earliestWakeup = scheduledTime;
+                compartments = 0;
+            }
+            if(scheduledTime == earliestWakeup) {
+                if(compartmentCount == 0) compartments |= 1UL << SINGLE_HATCH_COMPARTMENT; // Single hatch mode
+                else if(schedule.compartment < compartmentCount) compartments |= 1UL << schedule.compartment;
+            }
+        }
+
+        return earliestWakeup;
+    }
+
+    WakeTimestamp SleepSystemClass::getScheduleEntry(uint8_t index) {
+        portENTER_CRITICAL(&scheduleMux);
+        WakeTimestamp entry = MedicationSchedule[index < scheduleCount ? index : 0];
+        portEXIT_CRITICAL(&scheduleMux);
+        return entry;
+    }
+    bool SleepSystemClass::setSchedule(const WakeTimestamp* entries, uint8_t count) {
+        if(count == 0 || count > MAX_SCHEDULE_ENTRIES) return false;
+
+        // Swap in the new schedule
+            portENTER_CRITICAL(&scheduleMux);
+            memcpy(MedicationSchedule, entries, count * sizeof(WakeTimestamp));
+            scheduleCount = count;
+            portEXIT_CRITICAL(&scheduleMux);
+
+        // Store it: version, entry count, then the raw entries
+            File file = LittleFS.open(SCHEDULE_PATH, "w");
+            if(!file) {
+                printf("Failed to store the schedule\n");
+                return false;
+            }
+            const uint8_t header[] = {SCHEDULE_FILE_VERSION, count};
+            file.write(header, sizeof(header));
+            file.write((const uint8_t*)entries, count * sizeof(WakeTimestamp));
+            file.close();
+
+        printf("Schedule updated: %d entries\n", count);
+        return true;
+    }
 
 // Private
+    void SleepSystemClass::updateAlert() {
+        // Start with phase 1 when doses are due, escalate every CONF_ALERT_PHASE_S, give up after the last phase.
+        // Giving up lets the device sleep again, the doses stay due and light up on every wakeup until they are taken.
+            OutputState phase = alertPhase;
+            if(dueCompartments == 0) {
+                phase = OutputState::ON;
+                alertExpired = false;
+            } else if(alertExpired) {
+                phase = OutputState::ON;
+            } else if(phase == OutputState::ON) {
+                phase = OutputState::NOTIFICATION_PHASE_1;
+                alertSeconds = 0;
+            } else if(++alertSeconds >= CONF_ALERT_PHASE_S) {
+                alertSeconds = 0;
+                if(phase == OutputState::NOTIFICATION_PHASE_4) {
+                    printf("Alert not acknowledged, giving up until the next wakeup\n");
+                    phase = OutputState::ON;
+                    alertExpired = true;
+                } else {
+                    phase = (OutputState)((int)phase + 1);
+                }
+            }
+
+        // Only touch the output state on a change, so a state set through the server stays until then
+            if(phase != alertPhase) {
+                alertPhase = phase;
+                output.setState(phase);
+            }
+    }
+    void SleepSystemClass::loadSchedule() {
+        File file = LittleFS.open(SCHEDULE_PATH, "r");
+        if(!file) return; // Keep the default schedule
+
+        // Version 2 starts with SCHEDULE_FILE_VERSION and the count. Version 1 starts with the count (never above
+        // MAX_SCHEDULE_ENTRIES) and has no weekdays, its doses are taken every day.
+        uint8_t first = 0;
+        uint8_t count = 0;
+        bool versioned = file.read(&first, 1) == 1 && first == SCHEDULE_FILE_VERSION;
+        bool valid = versioned ? file.read(&count, 1) == 1 : (count = first) != 0;
+        valid = valid && count > 0 && count <= MAX_SCHEDULE_ENTRIES;
+
+        WakeTimestamp entries[MAX_SCHEDULE_ENTRIES];
+        for(uint8_t i = 0; valid && i < count; i++) {
+            uint8_t fields[sizeof(WakeTimestamp)] = {0, 0, 0, WEEKDAYS_ALL};
+            size_t length = versioned ? sizeof(WakeTimestamp) : SCHEDULE_V1_ENTRY_SIZE;
+            valid = file.read(fields, length) == (int)length;
+            entries[i] = {fields[0], fields[1], fields[2], fields[3]};
+        }
+        file.close();
+
+        if(valid) {
+            memcpy(MedicationSchedule, entries, count * sizeof(WakeTimestamp));
+            scheduleCount = count;
+            printf("Loaded schedule: %d entries%s\n", count, versioned ? "" : " (version 1)");
+        }
+    }
     void SleepSystemClass::setCurrentTime(int year, int month, int day, int hour, int minute, int second) {
         // Set the RTC time using the provided parameters
             struct tm t;
@@ -66,28 +302,20 @@
             // Wake on hatch open
                 esp_sleep_enable_ext0_wakeup(static_cast<gpio_num_t>(PIN_HATCH_BUTTON), 1); // Wake when GPIO goes high (hatch opened)
 
+            // Wake on compartment open (the expanders pull the shared interrupt line low)
+                if(input.data.compartmentCount > 0) {
+                    esp_sleep_enable_ext1_wakeup(1ULL << PIN_EXPANDER_INT, ESP_EXT1_WAKEUP_ALL_LOW);
+                }
+
             // Wake on scheduled medication times
                 struct tm currentTime = getCurrentTime();
                 time_t now = mktime(&currentTime);
-                time_t earliestWakeup = now + 24 * 3600; // Default to 24 hours later
-
-                for(const auto& schedule : MedicationSchedule) {
-                    struct tm wakeTime = currentTime;
-                    wakeTime.tm_hour = schedule.hour;
-                    wakeTime.tm_min = schedule.minute;
-                    wakeTime.tm_sec = 0;
-
-                    time_t scheduledTime = mktime(&wakeTime);
-                    if(scheduledTime <= now) {
-                        scheduledTime += 24 * 3600; // Schedule for next day if time has passed
-                    }
-
-                    if(scheduledTime < earliestWakeup) {
-                        earliestWakeup = scheduledTime;
-                    }
-                }
+                uint32_t wakeupCompartments = 0;
+                time_t earliestWakeup = nextWakeup(currentTime, wakeupCompartments);
 
                 esp_sleep_enable_timer_wakeup((earliestWakeup - now) * 1000000); // Convert to microseconds
+                scheduledWakeup = earliestWakeup;
+                scheduledCompartments = wakeupCompartments;
 
         // Print wakeup info
             printf("Entering deep sleep. Current time: %04d-%02d-%02d %02d:%02d:%02d\n",
@@ -100,6 +328,11 @@
                 wakeupTm.tm_year + 1900, wakeupTm.tm_mon + 1, wakeupTm.tm_mday,
                 wakeupTm.tm_hour, wakeupTm.tm_min, wakeupTm.tm_sec);
 
+        // Outputs are off while sleeping, store the state before the power domains go down
+            output.setState(OutputState::OFF);
+            journal.checkpoint();
+
         // Enter deep sleep
+            trace.record(TraceTask::SLEEP_SYSTEM, TraceEvent::SLEEP_ENTER, earliestWakeup - now);
             esp_deep_sleep_start();
     }
\ No newline at end of file
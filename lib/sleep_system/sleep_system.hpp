@@ -8,14 +8,26 @@
 // - Keep track of current time and medication schedule
 // - Wake any time the hatch is opened
 // - Wake on scheduled intervals when medication is due
+// - Wake any time a compartment is opened (shared I/O expander interrupt)
 // - Sleep when hatch is closed for more then a set time
+// - Light the compartments whose dose woke us up, until they are opened
+// - Without I/O expanders (single hatch mode) every dose is due in SINGLE_HATCH_COMPARTMENT, opening the main hatch takes it
+// - Alert (buzz, beep and breathing status pixel) while doses are due, escalating through the notification phases
+// - Continue where we left off after a reset (see journal)
 
 
 // Cnofigure the sleep system
 
+    #define MAX_SCHEDULE_ENTRIES 64 // Schedule capacity (uploaded in chunks, see server)
+    #define SINGLE_HATCH_COMPARTMENT 0 // Due bit of the main hatch when there are no compartments
+
+    #define WEEKDAYS_ALL 0x7F // Bit N is tm_wday N (0 = Sunday)
+
     struct WakeTimestamp {
         uint8_t hour;
         uint8_t minute;
+        uint8_t compartment; // Compartment holding this dose (ignored without I/O expanders)
+        uint8_t weekdays;    // Days the dose is taken on, bit N = tm_wday N (WEEKDAYS_ALL for every day)
     };
 
 class SleepSystemClass {
@@ -26,6 +38,14 @@ public:
 
     // Methods
         void begin(); // Initializes the sleep system
+        void step();  // One second of the sleep system task: doses taken, alert escalation and the sleep countdown
+        time_t nextWakeup(struct tm currentTime, uint32_t& compartments); // Next scheduled dose after currentTime and the compartments due then
+        static time_t nextWakeupOf(const WakeTimestamp* schedules, uint8_t count, uint8_t compartmentCount,
+                                   struct tm currentTime, uint32_t& compartments); // Same for any schedule (benchmarks, tests)
+
+        uint8_t getScheduleCount() { return scheduleCount; }
+        WakeTimestamp getScheduleEntry(uint8_t index);                  // Copy of one schedule entry
+        bool setSchedule(const WakeTimestamp* entries, uint8_t count);  // Replaces the schedule and stores it in LittleFS
 
 private:
     // Methods
@@ -35,20 +55,31 @@ private:
         struct tm getCurrentTime(); // Gets the current time from the RTC
 
         void enterDeepSleep(); // Enters deep sleep mode until next wakeup event. Automaticly configures to wake on hatch open or scheduled time.
+        void loadSchedule();   // Loads the stored schedule from LittleFS (keeps the default one if there is none), both file versions
+        void updateAlert();    // Sets the alert phase of the output from the due doses, called every second
 
     // Atributes
-        WakeTimestamp MedicationSchedule[8] {
-            {7, 0},  // 07:00
-            {9, 0},  // 09:00
-            {11, 0}, // 11:00
-            {13, 0}, // 13:00
-            {15, 0}, // 15:00
-            {17, 0}, // 17:00
-            {19, 0}, // 19:00
-            {21, 0}, // 21:00
+        WakeTimestamp MedicationSchedule[MAX_SCHEDULE_ENTRIES] {
+            {7, 0, 0, WEEKDAYS_ALL},  // 07:00
+            {9, 0, 1, WEEKDAYS_ALL},  // 09:00
+            {11, 0, 2, WEEKDAYS_ALL}, // 11:00
+            {13, 0, 3, WEEKDAYS_ALL}, // 13:00
+            {15, 0, 4, WEEKDAYS_ALL}, // 15:00
+            {17, 0, 5, WEEKDAYS_ALL}, // 17:00
+            {19, 0, 6, WEEKDAYS_ALL}, // 19:00
+            {21, 0, 7, WEEKDAYS_ALL}, // 21:00
         };
+        uint8_t scheduleCount = 8;
+
+        uint32_t dueCompartments = 0; // Compartments with a dose due that were not opened yet
+        uint8_t sleepCounter = 0;     // Seconds everything has been closed
+
+        OutputState alertPhase = OutputState::ON; // NOTIFICATION_PHASE_1..4 while alerting, ON otherwise
+        uint16_t alertSeconds = 0;                // Seconds in the current alert phase
+        bool alertExpired = false;                // The last phase ran out without the doses being taken
 
         int CONF_SLEEP_DELAY_HATCH_CLOSED_S = 10; // Time in seconds before entering sleep after hatch is closed
+        int CONF_ALERT_PHASE_S = 120;              // Time in seconds before the alert escalates to the next phase
 
     // References to other modules
         InputClass& input;
@@ -0,0 +1,112 @@
+#include "trace.hpp"
+#include <Arduino.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+
+#define TRACE_MAGIC 0x54524332 // "TRC2", marks the RTC buffer as initialized (with the current record layout)
+
+// Ring buffers in RTC memory (not cleared on deep sleep or software reset)
+struct TraceRing {
+    uint32_t head;                       // Total number of records written
+    TraceRecord records[TRACE_RING_SIZE];
+};
+
+RTC_NOINIT_ATTR static uint32_t traceMagic;
+RTC_NOINIT_ATTR static uint32_t traceBoot;
+RTC_NOINIT_ATTR static TraceRing traceRings[portNUM_PROCESSORS];
+
+static const char* taskNames[] = {"Setup", "InputTask", "OutputWorker", "SleepSystemTask", "ServerTask"};
+static const char* eventNames[] = {"BOOT", "HATCH_EDGE", "USER_SWITCH_EDGE", "OUTPUT_STATE", "SLEEP_COUNTDOWN", "SLEEP_ENTER", "REQUEST", "REQUEST", "COMPARTMENT_EDGE"};
+
+void TraceClass::begin() {
+    esp_reset_reason_t reason = esp_reset_reason();
+
+    // Initialize the buffer after power on (RTC memory contains garbage)
+        if (traceMagic != TRACE_MAGIC || reason == ESP_RST_POWERON) {
+            memset(traceRings, 0, sizeof(traceRings));
+            traceBoot = 0;
+            traceMagic = TRACE_MAGIC;
+        }
+
+    // Remember a crash, the dump waits until the alert is running again (a few kB over serial take seconds)
+        bool crashed = reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT ||
+            reason == ESP_RST_WDT || reason == ESP_RST_BROWNOUT;
+        crashReason = crashed ? reason : 0;
+
+    traceBoot++;
+    record(TraceTask::SETUP, TraceEvent::BOOT, reason);
+}
+
+void TraceClass::record(TraceTask task, TraceEvent event, uint32_t payload) {
+    // Masking interrupts on this core keeps the task from being preempted or migrated,
+    // the other core only ever writes its own ring.
+    uint32_t irqState = portSET_INTERRUPT_MASK_FROM_ISR();
+        uint32_t core = xPortGetCoreID();
+        TraceRing& ring = traceRings[core];
+        TraceRecord& rec = ring.records[ring.head & (TRACE_RING_SIZE - 1)];
+        uint64_t us = esp_timer_get_time();
+        rec.timeLow = (uint32_t)us;
+        rec.timeHigh = (uint16_t)(us >> 32);
+        rec.boot = (uint8_t)traceBoot;
+        rec.source = TRACE_SOURCE(core, (uint8_t)task, (uint8_t)event);
+        rec.payload = payload;
+        ring.head++;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(irqState);
+}
+
+void TraceClass::exportChromeJson(Print& out) {
+    bool first = true;
+
+    out.print("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    uint32_t namedBoots[256 / 32] = {0}; // Runs that already got their process / thread names
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        TraceRing& ring = traceRings[core];
+        uint32_t head = ring.head;
+        uint32_t count = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+
+        for (uint32_t i = head - count; i != head; i++) {
+            const TraceRecord& rec = ring.records[i & (TRACE_RING_SIZE - 1)];
+            uint8_t recEvent = TRACE_SOURCE_EVENT(rec.source);
+            if (recEvent >= sizeof(eventNames) / sizeof(eventNames[0])) continue;
+
+            // Every run is shown as its own process, with threads named after the tasks
+            if (!(namedBoots[rec.boot / 32] & (1UL << (rec.boot % 32)))) {
+                namedBoots[rec.boot / 32] |= 1UL << (rec.boot % 32);
+                out.printf("%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"Boot %u\"}}",
+                    first ? "" : ",", rec.boot, rec.boot);
+                first = false;
+                for (uint8_t t = 0; t < sizeof(taskNames) / sizeof(taskNames[0]); t++) {
+                    out.printf(",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                        rec.boot, t, taskNames[t]);
+                }
+            }
+
+            uint64_t us = (uint64_t)rec.timeHigh << 32 | rec.timeLow;
+
+            // Requests become duration slices, state changes counters, everything else instant events
+            TraceEvent event = (TraceEvent)recEvent;
+            const char* phase = "i";
+            if (event == TraceEvent::REQUEST_BEGIN) phase = "B";
+            else if (event == TraceEvent::REQUEST_END) phase = "E";
+            else if (event == TraceEvent::OUTPUT_STATE) phase = "C";
+
+            out.printf("%s{\"name\":\"%s\",\"ph\":\"%s\",\"s\":\"t\",\"ts\":%llu,\"pid\":%u,\"tid\":%u,\"args\":{\"value\":%u,\"core\":%u}}",
+                first ? "" : ",", eventNames[recEvent], phase, (unsigned long long)us, rec.boot,
+                TRACE_SOURCE_TASK(rec.source), (unsigned)rec.payload, TRACE_SOURCE_CORE(rec.source));
+        }
+    }
+
+    out.print("]}");
+}
+
+void TraceClass::dumpCrash(Print& out) {
+    if (crashReason == 0) return;
+
+    printf("Previous run ended with reset reason %u, trace dump follows:\n", (unsigned)crashReason);
+    exportChromeJson(out);
+    printf("\n");
+    crashReason = 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <Print.h>
+// This module records timing events from the FreeRTOS tasks into a binary ring buffer.
+//  - Every event is a fixed size record: timestamp, core, task, event id and payload.
+//  - Timestamps are esp_timer microseconds since boot, one clock shared by both cores, kept with 48 bits (~8.9 years)
+//    so they never wrap within a run. (The cycle counter wraps every ~18 s and is separate per core.)
+//  - Each core writes into its own ring with local interrupts masked, so recording never takes a lock.
+//  - The rings live in RTC memory and survive deep sleep as well as watchdog / panic resets.
+//  - The buffer is exported as Chrome / Perfetto trace JSON (over serial or the /trace endpoint).
+//    Save the output to a .json file and open it in ui.perfetto.dev or chrome://tracing.
+
+#define TRACE_RING_SIZE 128 // Records per core (must be a power of two)
+
+enum class TraceTask : uint8_t { // At most 8, packed into 3 bits
+    SETUP,
+    INPUT_TASK,
+    OUTPUT_WORKER,
+    SLEEP_SYSTEM,
+    SERVER_TASK
+};
+
+enum class TraceEvent : uint8_t { // At most 16, packed into 4 bits
+    BOOT,             // Payload: reset reason
+    HATCH_EDGE,       // Payload: new hatch state
+    USER_SWITCH_EDGE, // Payload: new user switch state
+    OUTPUT_STATE,     // Payload: new OutputState
+    SLEEP_COUNTDOWN,  // Payload: seconds until sleep
+    SLEEP_ENTER,      // Payload: seconds until scheduled wakeup
+    REQUEST_BEGIN,    // Payload: ServerRoute
+    REQUEST_END,      // Payload: ServerRoute
+    COMPARTMENT_EDGE  // Payload: compartment << 1 | new state
+};
+
+// Packing of TraceRecord::source
+#define TRACE_SOURCE(core, task, event) ((uint8_t)((core) << 7 | (task) << 4 | (event)))
+#define TRACE_SOURCE_CORE(source) ((source) >> 7)
+#define TRACE_SOURCE_TASK(source) (((source) >> 4) & 0x07)
+#define TRACE_SOURCE_EVENT(source) ((source) & 0x0F)
+
+struct TraceRecord {
+    uint32_t timeLow;  // esp_timer time in microseconds, bits 0..31
+    uint16_t timeHigh; // esp_timer time, bits 32..47
+    uint8_t boot;      // Boot sequence number, separates records of different runs
+    uint8_t source;    // Core (1 bit), TraceTask (3 bits) and TraceEvent (4 bits), see TRACE_SOURCE
+    uint32_t payload;  // Event specific value
+};
+static_assert(sizeof(TraceRecord) == 12, "TraceRecord must stay 12 bytes (RTC memory)");
+
+class TraceClass {
+public:
+    // Methods
+        void begin(); // Validates the RTC buffer and starts a new run, remembers if the previous run crashed
+        void record(TraceTask task, TraceEvent event, uint32_t payload = 0); // Safe to call from any task or ISR
+        void exportChromeJson(Print& out); // Writes the whole buffer as Chrome trace JSON
+        void dumpCrash(Print& out); // Writes the buffer once if the previous run crashed, call after the alert state is restored
+
+private:
+    // Attributes
+        uint32_t crashReason = 0; // Reset reason of the previous run if it ended in a crash, 0 (ESP_RST_UNKNOWN) if not
+};
@@ -1,15 +1,35 @@
 #include <Arduino.h>
+#include <LittleFS.h>
 
 #include <pinout.hpp>
 #include <server.hpp>
 #include <output.hpp>
 #include <input.hpp>
 #include <sleep_system.hpp>
+#include <trace.hpp>
+#include <metrics.hpp>
+#include <power.hpp>
+#include <bench.hpp>
+#include <dose_log.hpp>
+#include <led.hpp>
+#include <journal.hpp>
 
 ServerClass server;
 OuptutClass output;
 InputClass input;
 SleepSystemClass sleepSystem(input, output, server);
+TraceClass trace;
+MetricsClass metrics;
+PowerClass power(input);
+#ifdef BENCH_ENABLED
+BenchClass bench(server);
+#endif
+DoseLogClass doseLog;
+LedClass led;
+JournalClass journal;
+
+// Unit tests bring their own entry point and use the modules above
+#ifndef PIO_UNIT_TESTING
 
 void setup() {
     // Start Serial for debugging
@@ -17,11 +37,29 @@ void setup() {
         delay(100);
         printf("\n\nMedication Notifier Starting...\n");
 
-    // Initialize output module
+    // Initialize tracing and metrics first, so every other module can record events
+        trace.begin();
+        metrics.begin();
+
+    // Mount the filesystem (web page, schedule, dose log and journal checkpoint)
+        if (!LittleFS.begin(true)) {
+            printf("Failed to mount LittleFS!\n");
+        } else {
+            printf("LittleFS mounted successfully\n");
+        }
+        doseLog.begin();
+        journal.begin(); // Recovers the alert state, before the modules that restore it
+
+    // Initialize the WS2812B renderer and the output module
+        led.begin();
         output.begin();
 
     // Initialize input module
         input.begin();
+        output.setCompartmentCount(input.data.compartmentCount);
+
+    // Initialize power governor (before the server, AP and NTP depend on the tier)
+        power.begin();
 
     // Initialize sleep system
         sleepSystem.begin();
@@ -31,9 +69,14 @@ void setup() {
 
     // Finnish setup
         printf("Setup complete.\n");
+
+    // Dump the trace of a crashed previous run, only now that the alert is restored and the tasks are running
+        trace.dumpCrash(Serial);
 }
 
 void loop() {
     // Your main loop tasks here
         delay(10000000);
-}
\ No newline at end of file
+}
+
+#endif
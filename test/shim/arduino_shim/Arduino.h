@@ -0,0 +1,102 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <Print.h>
+#include <WString.h>
+#include <esp_attr.h>
+#include <esp_sleep.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+// Host shim of the Arduino / ESP32 / FreeRTOS API, just enough to build the firmware for the native test env.
+//  - Time comes from the host's monotonic clock, the "cycle counter" counts nanoseconds (getCpuFrequencyMhz() is 1000).
+//  - Tasks are never started, tests call the modules' functions directly. Code runs on core shimCoreId (0 unless a test changes it).
+//  - Locks and interrupt masks do nothing, the tests are single threaded.
+//  - GPIOs read LOW, ADC pins read shimAnalogValue, writes are ignored.
+
+// GPIO
+    #define LOW 0
+    #define HIGH 1
+    #define INPUT 0x01
+    #define OUTPUT 0x03
+    #define INPUT_PULLUP 0x05
+    #define RISING 0x01
+    #define FALLING 0x02
+    #define CHANGE 0x03
+
+    inline void pinMode(uint8_t, uint8_t) {}
+    inline void digitalWrite(uint8_t, uint8_t) {}
+    inline int digitalRead(uint8_t) { return LOW; }
+    extern uint16_t shimAnalogValue; // Raw 12 bit reading of every ADC pin, tests choose it
+    inline uint16_t analogRead(uint8_t) { return shimAnalogValue; }
+    inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+    inline void attachInterrupt(int, void (*)(), int) {}
+
+// Time
+    unsigned long millis();
+    unsigned long micros();
+    void delay(uint32_t ms);
+    inline uint32_t getCpuFrequencyMhz() { return 1000; }
+
+// FreeRTOS
+    typedef void* TaskHandle_t;
+    typedef void* SemaphoreHandle_t;
+    typedef int BaseType_t;
+    typedef unsigned UBaseType_t;
+    typedef uint32_t TickType_t;
+    typedef int portMUX_TYPE;
+
+    #define pdTRUE 1
+    #define pdFALSE 0
+    #define pdPASS 1
+    #define portMAX_DELAY 0xFFFFFFFF
+    #define portTICK_PERIOD_MS 1
+    #define portNUM_PROCESSORS 2
+    #define portMUX_INITIALIZER_UNLOCKED 0
+    #define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+    inline BaseType_t xTaskCreate(void (*)(void*), const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*) { return pdPASS; }
+    inline TaskHandle_t xTaskGetCurrentTaskHandle() { return nullptr; }
+    extern BaseType_t shimCoreId;
+    inline BaseType_t xPortGetCoreID() { return shimCoreId; }
+    inline void vTaskDelay(TickType_t ticks) { delay(ticks); }
+    inline void xTaskNotifyGive(TaskHandle_t) {}
+    inline void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t*) {}
+    inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+    inline void portYIELD_FROM_ISR(BaseType_t = 0) {}
+
+    inline SemaphoreHandle_t xSemaphoreCreateMutex() { return (SemaphoreHandle_t)1; }
+    inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+    inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+
+    inline void portENTER_CRITICAL(portMUX_TYPE*) {}
+    inline void portEXIT_CRITICAL(portMUX_TYPE*) {}
+    inline void portENTER_CRITICAL_ISR(portMUX_TYPE*) {}
+    inline void portEXIT_CRITICAL_ISR(portMUX_TYPE*) {}
+    inline uint32_t portSET_INTERRUPT_MASK_FROM_ISR() { return 0; }
+    inline void portCLEAR_INTERRUPT_MASK_FROM_ISR(uint32_t) {}
+
+// ESP
+    class EspClass {
+    public:
+        uint32_t getCycleCount();
+        uint32_t getFreeHeap() { return 0; }
+    };
+    extern EspClass ESP;
+
+// Serial (stdout)
+    class HardwareSerial : public Print {
+    public:
+        void begin(unsigned long) {}
+        size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+        size_t write(const uint8_t* buffer, size_t size) override { return fwrite(buffer, 1, size, stdout); }
+        using Print::write;
+    };
+    extern HardwareSerial Serial;
+
+// NTP (never synced on the host)
+    inline void configTime(long, int, const char*) {}
+    inline bool getLocalTime(struct tm*) { return false; }
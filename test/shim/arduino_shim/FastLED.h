@@ -0,0 +1,84 @@
+#pragma once
+#include <stdint.h>
+// Host shim of the FastLED API used by the LED renderer. Nothing is sent anywhere, show() only counts.
+// CHSV to CRGB is a plain piecewise linear conversion, close to but not bit exact with FastLED's rainbow.
+
+enum HSVHue {
+    HUE_RED = 0,
+    HUE_ORANGE = 32,
+    HUE_YELLOW = 64,
+    HUE_GREEN = 96,
+    HUE_AQUA = 128,
+    HUE_BLUE = 160,
+    HUE_PURPLE = 192,
+    HUE_PINK = 224
+};
+
+struct CHSV {
+    union { uint8_t hue; uint8_t h; };
+    union { uint8_t sat; uint8_t saturation; uint8_t s; };
+    union { uint8_t val; uint8_t value; uint8_t v; };
+
+    CHSV() : hue(0), sat(0), val(0) {}
+    CHSV(uint8_t p_hue, uint8_t p_sat, uint8_t p_val) : hue(p_hue), sat(p_sat), val(p_val) {}
+};
+
+struct CRGB {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+
+    enum HTMLColorCode {
+        Black = 0x000000,
+        Red = 0xFF0000,
+        Orange = 0xFFA500,
+        Yellow = 0xFFFF00,
+        Green = 0x008000,
+        Blue = 0x0000FF,
+        White = 0xFFFFFF
+    };
+
+    CRGB() : r(0), g(0), b(0) {}
+    CRGB(uint8_t p_r, uint8_t p_g, uint8_t p_b) : r(p_r), g(p_g), b(p_b) {}
+    CRGB(HTMLColorCode code) : r(code >> 16), g(code >> 8), b(code) {}
+    CRGB(const CHSV& hsv);
+
+    bool operator==(const CRGB& other) const { return r == other.r && g == other.g && b == other.b; }
+    bool operator!=(const CRGB& other) const { return !(*this == other); }
+};
+
+enum ShimChipset { WS2812B };
+enum EOrder { RGB, GRB };
+
+#define DISABLE_DITHER 0x00
+#define BINARY_DITHER 0x01
+
+class CLEDController {
+public:
+    CLEDController& setLeds(CRGB* p_leds, int p_count) {
+        leds = p_leds;
+        count = p_count;
+        return *this;
+    }
+
+    CRGB* leds = nullptr;
+    int count = 0;
+};
+
+class CFastLED {
+public:
+    template<ShimChipset CHIPSET, int DATA_PIN, EOrder RGB_ORDER>
+    CLEDController& addLeds(CRGB* leds, int count) {
+        return controller.setLeds(leds, count);
+    }
+    void setBrightness(uint8_t p_brightness) { brightness = p_brightness; }
+    void setDither(uint8_t p_dither) { dither = p_dither; }
+    void clear(bool writeData = false);
+    void show() { shows++; }
+
+    CLEDController controller;
+    uint8_t brightness = 255;
+    uint8_t dither = BINARY_DITHER;
+    uint32_t shows = 0; // Frames "sent" to the strip
+};
+extern CFastLED FastLED;
@@ -0,0 +1,60 @@
+#pragma once
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+// Host shim of LittleFS, an in-memory filesystem.
+// Like LittleFS, a file opened for writing replaces the stored one when it is closed, not before.
+
+typedef std::vector<uint8_t> ShimFileData;
+
+class File : public Print {
+public:
+    File() {}
+    File(const std::string& p_path, std::shared_ptr<ShimFileData> p_data, bool p_writable, class LittleFSFS* p_fs)
+        : path(p_path), data(p_data), writable(p_writable), fs(p_fs) {}
+
+    explicit operator bool() const { return data != nullptr; }
+
+    // Reading
+        int read(uint8_t* buffer, size_t size);
+        int read();
+        int available() { return data ? (int)(data->size() - cursor) : 0; }
+        String readString();
+        String readStringUntil(char terminator);
+        bool seek(size_t p_position);
+        size_t position() { return cursor; }
+        size_t size() { return data ? data->size() : 0; }
+
+    // Writing
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        size_t write(const uint8_t* buffer, size_t size) override;
+        using Print::write;
+
+        void close();
+
+private:
+    std::string path;
+    std::shared_ptr<ShimFileData> data;
+    bool writable = false;
+    size_t cursor = 0;
+    class LittleFSFS* fs = nullptr;
+};
+
+class LittleFSFS {
+public:
+    bool begin(bool = false) { return true; }
+    File open(const char* path, const char* mode = "r");
+    bool exists(const char* path) { return files.count(path) > 0; }
+    bool remove(const char* path) { return files.erase(path) > 0; }
+    bool rename(const char* from, const char* to);
+
+    // Test helpers
+        void format() { files.clear(); }
+        bool loadHostFile(const char* path, const char* hostPath); // Copies a file of the host into the filesystem
+        std::string failWrites; // Opening this path for writing fails (flash full), empty for none
+
+    std::map<std::string, std::shared_ptr<ShimFileData>> files;
+};
+extern LittleFSFS LittleFS;
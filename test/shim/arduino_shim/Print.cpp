@@ -0,0 +1,18 @@
+#include "Print.h"
+#include <stdarg.h>
+#include <vector>
+
+size_t Print::printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(nullptr, 0, format, copy);
+    va_end(copy);
+
+    std::vector<char> buffer(length + 1);
+    vsnprintf(buffer.data(), buffer.size(), format, args);
+    va_end(args);
+
+    return write((const uint8_t*)buffer.data(), length);
+}
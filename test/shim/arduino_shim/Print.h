@@ -0,0 +1,24 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+// Host version of the Arduino Print class (only what the firmware uses).
+
+class Print {
+public:
+    virtual ~Print() {}
+
+    // Methods
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t* buffer, size_t size) {
+            for (size_t i = 0; i < size; i++) write(buffer[i]);
+            return size;
+        }
+        virtual void flush() {}
+
+        size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+        size_t print(const char* text) { return write(text); }
+        size_t println(const char* text = "") { return print(text) + print("\r\n"); }
+        size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+// Host version of the Arduino String class, backed by std::string.
+
+class String {
+public:
+    // Constructors
+        String() {}
+        String(const char* text) : value(text ? text : "") {}
+        String(const std::string& text) : value(text) {}
+        String(int number) : value(std::to_string(number)) {}
+        String(unsigned number) : value(std::to_string(number)) {}
+        String(long number) : value(std::to_string(number)) {}
+        String(unsigned long number) : value(std::to_string(number)) {}
+        String(float number, unsigned decimals) {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%.*f", (int)decimals, number);
+            value = buffer;
+        }
+
+    // Methods
+        const char* c_str() const { return value.c_str(); }
+        size_t length() const { return value.size(); }
+        bool isEmpty() const { return value.empty(); }
+        void reserve(size_t size) { value.reserve(size); }
+        long toInt() const { return atol(value.c_str()); }
+        int indexOf(const char* text) const {
+            size_t position = value.find(text);
+            return position == std::string::npos ? -1 : (int)position;
+        }
+        bool startsWith(const char* prefix) const { return value.rfind(prefix, 0) == 0; }
+        String substring(size_t from) const { return from < value.size() ? String(value.substr(from)) : String(); }
+        String substring(size_t from, size_t to) const { return from < to && from < value.size() ? String(value.substr(from, to - from)) : String(); }
+
+        String& operator+=(const String& other) { value += other.value; return *this; }
+        String& operator+=(const char* text) { value += text; return *this; }
+        String& operator+=(char c) { value += c; return *this; }
+        bool operator==(const String& other) const { return value == other.value; }
+        bool operator==(const char* text) const { return value == text; }
+        bool operator!=(const char* text) const { return value != text; }
+
+private:
+    // Attributes
+        std::string value;
+};
+
+inline String operator+(const String& a, const String& b) { String result(a); result += b; return result; }
+inline String operator+(const String& a, const char* b) { String result(a); result += b; return result; }
+inline String operator+(const char* a, const String& b) { String result(a); result += b; return result; }
@@ -0,0 +1,118 @@
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+// Host shim of the ESP32 WebServer. There is no network, tests call request() to run a route's handlers
+// and read the response (status, content type and body, chunked content included) from the server.
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define HTTP_RAW_BUFLEN 1436
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_POST, HTTP_PUT, HTTP_DELETE };
+enum HTTPRawStatus { RAW_START, RAW_WRITE, RAW_END, RAW_ABORTED };
+
+struct HTTPRaw {
+    HTTPRawStatus status;
+    size_t totalSize;
+    size_t currentSize;
+    uint8_t buf[HTTP_RAW_BUFLEN];
+};
+
+class WebServer {
+public:
+    typedef std::function<void()> THandlerFunction;
+
+    WebServer(int) {}
+
+    // Routes
+        void on(const char* uri, THandlerFunction handler) { on(uri, HTTP_ANY, handler); }
+        void on(const char* uri, HTTPMethod method, THandlerFunction handler) { on(uri, method, handler, nullptr); }
+        void on(const char* uri, HTTPMethod method, THandlerFunction handler, THandlerFunction rawHandler) {
+            routes.push_back({uri, method, handler, rawHandler});
+        }
+        void begin() {}
+        void handleClient() {}
+        void collectHeaders(const char**, size_t) {}
+
+    // Request
+        String uri() { return String(requestUri); }
+        bool hasArg(const char* name) { return args.count(name) > 0; }
+        String arg(const char* name) { return hasArg(name) ? String(args[name]) : String(); }
+        String header(const char* name) { return headers.count(name) ? String(headers[name]) : String(); }
+        HTTPRaw& raw() { return rawBody; }
+
+    // Response
+        void setContentLength(size_t) {}
+        void sendHeader(const char*, const char*) {}
+        void send(int code, const char* type, const String& content) {
+            responseCode = code;
+            responseType = type;
+            responseBody.clear();
+            responseLength = 0;
+            sendContent(content);
+        }
+        void send(int code, const char* type, const char* content) { send(code, type, String(content)); }
+        void sendContent(const char* content, size_t length) {
+            responseLength += length;
+            if (keepResponseBody) responseBody.append(content, length);
+        }
+        void sendContent(const String& content) { sendContent(content.c_str(), content.length()); }
+
+    // Runs the route of a request: the raw body handler (if any) with the body, then the request handler.
+    // Returns false if there is no such route.
+        bool request(HTTPMethod method, const char* uri, const std::map<std::string, std::string>& requestArgs = {},
+                     const std::map<std::string, std::string>& requestHeaders = {}, const std::string& body = "") {
+            for (const Route& route : routes) {
+                if (route.uri != uri || (route.method != HTTP_ANY && route.method != method)) continue;
+
+                requestUri = uri;
+                args = requestArgs;
+                headers = requestHeaders;
+                responseCode = 0;
+                responseType.clear();
+                responseBody.clear();
+                responseLength = 0;
+
+                if (route.rawHandler && !body.empty()) {
+                    rawBody.status = RAW_START;
+                    rawBody.totalSize = 0;
+                    rawBody.currentSize = 0;
+                    route.rawHandler();
+                    for (size_t offset = 0; offset < body.size(); offset += HTTP_RAW_BUFLEN) {
+                        rawBody.status = RAW_WRITE;
+                        rawBody.currentSize = body.size() - offset < HTTP_RAW_BUFLEN ? body.size() - offset : HTTP_RAW_BUFLEN;
+                        memcpy(rawBody.buf, body.data() + offset, rawBody.currentSize);
+                        rawBody.totalSize += rawBody.currentSize;
+                        route.rawHandler();
+                    }
+                    rawBody.status = RAW_END;
+                    route.rawHandler();
+                }
+                route.handler();
+                return true;
+            }
+            return false;
+        }
+
+        int responseCode = 0;
+        std::string responseType;
+        std::string responseBody;
+        size_t responseLength = 0;     // Body bytes sent, also when the body is not kept
+        bool keepResponseBody = true;  // Off for tests that measure the heap, the body would grow it
+
+private:
+    struct Route {
+        std::string uri;
+        HTTPMethod method;
+        THandlerFunction handler;
+        THandlerFunction rawHandler;
+    };
+
+    std::vector<Route> routes;
+    std::string requestUri;
+    std::map<std::string, std::string> args;
+    std::map<std::string, std::string> headers;
+    HTTPRaw rawBody = {};
+};
@@ -0,0 +1,30 @@
+#pragma once
+#include <Arduino.h>
+// Host shim of the WiFi API: no networks, the AP starts but nobody can connect.
+
+#define WIFI_OFF 0
+#define WIFI_STA 1
+#define WIFI_AP 2
+#define WIFI_AP_STA 3
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+class IPAddress {
+public:
+    String toString() const { return String("0.0.0.0"); }
+};
+
+class WiFiClass {
+public:
+    bool mode(int) { return true; }
+    bool softAP(const char*, const char*) { return true; }
+    bool softAPdisconnect(bool = false) { return true; }
+    IPAddress softAPIP() { return IPAddress(); }
+    IPAddress localIP() { return IPAddress(); }
+    int16_t scanNetworks() { return 0; }
+    String SSID(uint8_t) { return String(); }
+    int begin(const char*, const char*) { return WL_DISCONNECTED; }
+    int status() { return WL_DISCONNECTED; }
+    bool disconnect(bool = false) { return true; }
+};
+extern WiFiClass WiFi;
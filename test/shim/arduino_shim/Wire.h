@@ -0,0 +1,15 @@
+#pragma once
+#include <Arduino.h>
+// Host shim of the I2C API: nothing is connected, every address NACKs.
+
+class TwoWire {
+public:
+    bool begin(int, int, uint32_t) { return true; }
+    void beginTransmission(uint8_t) {}
+    size_t write(uint8_t) { return 1; }
+    uint8_t endTransmission(bool = true) { return 2; } // Address NACK
+    uint8_t requestFrom(uint8_t, uint8_t) { return 0; }
+    int available() { return 0; }
+    int read() { return -1; }
+};
+extern TwoWire Wire;
@@ -0,0 +1,7 @@
+#pragma once
+// RTC memory is plain memory on the host
+
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
+#define DRAM_ATTR
+#define IRAM_ATTR
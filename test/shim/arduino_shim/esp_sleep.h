@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <esp_system.h>
+// Deep sleep never happens on the host, tests choose the wakeup cause the next "boot" sees.
+// esp_deep_sleep_start() throws ShimRestart like esp_restart(), the test catches it where the device would sleep.
+
+typedef enum {
+    ESP_SLEEP_WAKEUP_UNDEFINED,
+    ESP_SLEEP_WAKEUP_ALL,
+    ESP_SLEEP_WAKEUP_EXT0,
+    ESP_SLEEP_WAKEUP_EXT1,
+    ESP_SLEEP_WAKEUP_TIMER
+} esp_sleep_wakeup_cause_t;
+
+typedef enum {
+    ESP_EXT1_WAKEUP_ALL_LOW,
+    ESP_EXT1_WAKEUP_ANY_HIGH
+} esp_sleep_ext1_wakeup_mode_t;
+
+typedef int gpio_num_t;
+
+extern esp_sleep_wakeup_cause_t shimWakeupCause;
+
+inline esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() { return shimWakeupCause; }
+inline void esp_sleep_enable_ext0_wakeup(gpio_num_t, int) {}
+inline void esp_sleep_enable_ext1_wakeup(uint64_t, esp_sleep_ext1_wakeup_mode_t) {}
+inline void esp_sleep_enable_timer_wakeup(uint64_t) {}
+[[noreturn]] inline void esp_deep_sleep_start() { throw ShimRestart(); }
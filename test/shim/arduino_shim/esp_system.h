@@ -0,0 +1,24 @@
+#pragma once
+// Reset reason and restart, tests choose the reason the next "boot" sees
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT,
+    ESP_RST_WDT,
+    ESP_RST_DEEPSLEEP,
+    ESP_RST_BROWNOUT,
+    ESP_RST_SDIO
+} esp_reset_reason_t;
+
+// Thrown by esp_restart(), a test catches it where the device would have reset
+struct ShimRestart {};
+
+extern esp_reset_reason_t shimResetReason;
+
+inline esp_reset_reason_t esp_reset_reason() { return shimResetReason; }
+[[noreturn]] inline void esp_restart() { throw ShimRestart(); }
@@ -0,0 +1,150 @@
+#include <Arduino.h>
+#include <FastLED.h>
+#include <LittleFS.h>
+#include <WiFi.h>
+#include <Wire.h>
+#include <chrono>
+#include <thread>
+
+// Global objects of the Arduino core and libraries
+EspClass ESP;
+HardwareSerial Serial;
+CFastLED FastLED;
+LittleFSFS LittleFS;
+WiFiClass WiFi;
+TwoWire Wire;
+
+esp_reset_reason_t shimResetReason = ESP_RST_POWERON;
+esp_sleep_wakeup_cause_t shimWakeupCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+uint16_t shimAnalogValue = 0;
+BaseType_t shimCoreId = 0;
+
+static const std::chrono::steady_clock::time_point shimStart = std::chrono::steady_clock::now();
+
+// Time
+    static uint64_t elapsedNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - shimStart).count();
+    }
+
+    unsigned long millis() { return elapsedNs() / 1000000; }
+    unsigned long micros() { return elapsedNs() / 1000; }
+    int64_t esp_timer_get_time() { return elapsedNs() / 1000; }
+    uint32_t EspClass::getCycleCount() { return (uint32_t)elapsedNs(); }
+    void delay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+// FastLED
+    CRGB::CRGB(const CHSV& hsv) {
+        // Six linear sections around the wheel, then saturation and value
+        uint8_t section = hsv.hue / 43;
+        uint8_t rise = (hsv.hue - section * 43) * 6;
+        uint8_t fall = 255 - rise;
+        uint8_t channels[3];
+        switch (section) {
+            case 0: channels[0] = 255; channels[1] = rise; channels[2] = 0; break;
+            case 1: channels[0] = fall; channels[1] = 255; channels[2] = 0; break;
+            case 2: channels[0] = 0; channels[1] = 255; channels[2] = rise; break;
+            case 3: channels[0] = 0; channels[1] = fall; channels[2] = 255; break;
+            case 4: channels[0] = rise; channels[1] = 0; channels[2] = 255; break;
+            default: channels[0] = 255; channels[1] = 0; channels[2] = fall; break;
+        }
+        uint8_t white = 255 - hsv.sat;
+        for (uint8_t& c : channels) {
+            c = (c * hsv.sat / 255 + white) * hsv.val / 255;
+        }
+        r = channels[0];
+        g = channels[1];
+        b = channels[2];
+    }
+
+    void CFastLED::clear(bool writeData) {
+        for (int i = 0; i < controller.count; i++) controller.leds[i] = CRGB();
+        if (writeData) show();
+    }
+
+// LittleFS
+    int File::read(uint8_t* buffer, size_t size) {
+        if (!data) return -1;
+        size_t count = size < data->size() - cursor ? size : data->size() - cursor;
+        memcpy(buffer, data->data() + cursor, count);
+        cursor += count;
+        return count;
+    }
+
+    int File::read() {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+
+    String File::readString() {
+        std::string text;
+        int c;
+        while ((c = read()) >= 0) text += (char)c;
+        return String(text);
+    }
+
+    String File::readStringUntil(char terminator) {
+        std::string text;
+        int c;
+        while ((c = read()) >= 0 && c != terminator) text += (char)c;
+        return String(text);
+    }
+
+    bool File::seek(size_t p_position) {
+        if (!data || p_position > data->size()) return false;
+        cursor = p_position;
+        return true;
+    }
+
+    size_t File::write(const uint8_t* buffer, size_t size) {
+        if (!data || !writable) return 0;
+        if (cursor + size > data->size()) data->resize(cursor + size);
+        memcpy(data->data() + cursor, buffer, size);
+        cursor += size;
+        return size;
+    }
+
+    void File::close() {
+        // Written files replace the stored one on close
+        if (data && writable) fs->files[path] = data;
+        data = nullptr;
+    }
+
+    File LittleFSFS::open(const char* path, const char* mode) {
+        auto stored = files.find(path);
+        if (mode[0] == 'r') {
+            if (stored == files.end()) return File();
+            return File(path, stored->second, false, this);
+        }
+
+        if (failWrites == path) return File();
+
+        // Work on a copy, "w" starts empty and "a" continues the stored content
+        auto copy = std::make_shared<ShimFileData>();
+        if (mode[0] == 'a' && stored != files.end()) *copy = *stored->second;
+        File file(path, copy, true, this);
+        file.seek(copy->size());
+        return file;
+    }
+
+    bool LittleFSFS::rename(const char* from, const char* to) {
+        auto stored = files.find(from);
+        if (stored == files.end()) return false;
+        files[to] = stored->second;
+        files.erase(from);
+        return true;
+    }
+
+    bool LittleFSFS::loadHostFile(const char* path, const char* hostPath) {
+        FILE* host = fopen(hostPath, "rb");
+        if (!host) return false;
+
+        auto copy = std::make_shared<ShimFileData>();
+        uint8_t buffer[256];
+        size_t length;
+        while ((length = fread(buffer, 1, sizeof(buffer), host)) > 0) {
+            copy->insert(copy->end(), buffer, buffer + length);
+        }
+        fclose(host);
+        files[path] = copy;
+        return true;
+    }
@@ -0,0 +1,53 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include <bench.hpp>
+// Runs the benchmark suite against test/bench_baseline.json, a regression fails the test.
+// Runs on the host (pio test -e native) and on the device (pio test -e esp32_bench, which embeds the baseline).
+
+extern BenchClass bench;
+
+#ifndef ESP32
+static String baseline;
+#endif
+
+void setUp() {}
+void tearDown() {}
+
+void test_bench_baseline() {
+    bool pass = bench.run();
+    bench.exportJson(Serial);
+    Serial.println();
+    TEST_ASSERT_TRUE_MESSAGE(pass, "A benchmark regressed against test/bench_baseline.json");
+}
+
+int runUnityTests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_bench_baseline);
+    return UNITY_END();
+}
+
+#ifdef ESP32
+
+void setup() {
+    delay(2000); // Wait for the test runner to open the serial port
+    LittleFS.begin(true);
+    runUnityTests();
+}
+
+void loop() {}
+
+#else
+
+int main() {
+    // The host has no flash, load the baseline and the root page from the project
+        File file = LittleFS.loadHostFile("/baseline.json", NATIVE_PROJECT_DIR "/test/bench_baseline.json")
+            ? LittleFS.open("/baseline.json") : File();
+        if (file) baseline = file.readString();
+        bench.setBaseline(baseline.c_str());
+        LittleFS.loadHostFile("/index.html", NATIVE_PROJECT_DIR "/data/index.html");
+
+    return runUnityTests();
+}
+
+#endif
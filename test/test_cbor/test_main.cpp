@@ -0,0 +1,216 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include <cbor.hpp>
+// CBOR codec tests (native only): CborWriter output read back with CborReader.
+//  - Nested maps and arrays, integers and string lengths in every head size (inline, 1, 2, 4 and 8 bytes).
+//  - Truncated input at every length and malformed heads fail cleanly, without reading past the end.
+
+// Collects everything written to it
+class StringPrint : public Print {
+public:
+    std::string text;
+    size_t write(uint8_t c) override {
+        text += (char)c;
+        return 1;
+    }
+};
+
+static const uint32_t headValues[] = {0, 23, 24, 255, 256, 65535, 65536, UINT32_MAX};
+
+// {"values": [...headValues], "nested": {"empty": [], "deep": [[1, "x"], {"k": 2}]}, "long": <300 x 'a'>}
+static std::string encodeDocument() {
+    StringPrint out;
+    CborWriter writer(out);
+    writer.beginMap(3);
+        writer.writeString("values");
+        writer.beginArray(sizeof(headValues) / sizeof(headValues[0]));
+        for (uint32_t value : headValues) writer.writeUint(value);
+
+        writer.writeString("nested");
+        writer.beginMap(2);
+            writer.writeString("empty");
+            writer.beginArray(0);
+            writer.writeString("deep");
+            writer.beginArray(2);
+                writer.beginArray(2);
+                    writer.writeUint(1);
+                    writer.writeString("x");
+                writer.beginMap(1);
+                    writer.writeString("k");
+                    writer.writeUint(2);
+
+        writer.writeString("long");
+        writer.writeString(std::string(300, 'a').c_str());
+    return out.text;
+}
+
+// Reads the document back, false at the first item that can't be read or doesn't match
+static bool decodeDocument(const std::string& data) {
+    CborReader reader((const uint8_t*)data.data(), data.size());
+    char text[320];
+    uint32_t count, value;
+
+    if (!reader.readMap(count) || count != 3) return false;
+        if (!reader.readString(text, sizeof(text)) || strcmp(text, "values") != 0) return false;
+        if (!reader.readArray(count) || count != sizeof(headValues) / sizeof(headValues[0])) return false;
+        for (uint32_t expected : headValues) {
+            if (!reader.readUint(value) || value != expected) return false;
+        }
+
+        if (!reader.readString(text, sizeof(text)) || strcmp(text, "nested") != 0) return false;
+        if (!reader.readMap(count) || count != 2) return false;
+            if (!reader.readString(text, sizeof(text)) || strcmp(text, "empty") != 0) return false;
+            if (!reader.readArray(count) || count != 0) return false;
+            if (!reader.readString(text, sizeof(text)) || strcmp(text, "deep") != 0) return false;
+            if (!reader.readArray(count) || count != 2) return false;
+                if (!reader.readArray(count) || count != 2) return false;
+                    if (!reader.readUint(value) || value != 1) return false;
+                    if (!reader.readString(text, sizeof(text)) || strcmp(text, "x") != 0) return false;
+                if (!reader.readMap(count) || count != 1) return false;
+                    if (!reader.readString(text, sizeof(text)) || strcmp(text, "k") != 0) return false;
+                    if (!reader.readUint(value) || value != 2) return false;
+
+        if (!reader.readString(text, sizeof(text)) || strcmp(text, "long") != 0) return false;
+        if (!reader.readString(text, sizeof(text)) || std::string(text) != std::string(300, 'a')) return false;
+    return reader.ok() && reader.atEnd();
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_head_sizes() {
+    // Shortest encoding of every value: initial byte, then 0, 1, 2, 4 or 8 big endian bytes
+    static const struct { uint64_t value; const char* encoded; size_t length; } cases[] = {
+        {0, "\x00", 1}, {23, "\x17", 1},
+        {24, "\x18\x18", 2}, {255, "\x18\xFF", 2},
+        {256, "\x19\x01\x00", 3}, {65535, "\x19\xFF\xFF", 3},
+        {65536, "\x1A\x00\x01\x00\x00", 5}, {UINT32_MAX, "\x1A\xFF\xFF\xFF\xFF", 5},
+        {1ULL << 32, "\x1B\x00\x00\x00\x01\x00\x00\x00\x00", 9},
+    };
+
+    for (const auto& c : cases) {
+        StringPrint out;
+        CborWriter(out).writeUint(c.value);
+        TEST_ASSERT_EQUAL(c.length, out.text.size());
+        TEST_ASSERT_EQUAL(0, memcmp(c.encoded, out.text.data(), c.length));
+
+        // Values above 32 bits are read as an error (the API never sends them)
+        uint32_t value;
+        CborReader reader((const uint8_t*)out.text.data(), out.text.size());
+        TEST_ASSERT_EQUAL(c.value <= UINT32_MAX, reader.readUint(value));
+        if (c.value <= UINT32_MAX) TEST_ASSERT_EQUAL((uint32_t)c.value, value);
+        TEST_ASSERT_TRUE(reader.atEnd()); // The whole head was consumed either way
+    }
+
+    // A longer head than needed is valid CBOR, the reader accepts it
+        static const uint8_t wide[] = {0x1B, 0, 0, 0, 0, 0, 0, 0, 5};
+        CborReader reader(wide, sizeof(wide));
+        uint32_t value;
+        TEST_ASSERT_TRUE(reader.readUint(value));
+        TEST_ASSERT_EQUAL(5, value);
+
+    // Negative integers, booleans and null
+        StringPrint out;
+        CborWriter writer(out);
+        writer.writeInt(-1);
+        writer.writeInt(-25);
+        writer.writeInt(7);
+        writer.writeBool(false);
+        writer.writeBool(true);
+        writer.writeNull();
+        TEST_ASSERT_EQUAL(0, memcmp("\x20\x38\x18\x07\xF4\xF5\xF6", out.text.data(), 7));
+        TEST_ASSERT_EQUAL(7, out.text.size());
+}
+
+void test_container_lengths() {
+    // Array and map heads of every size, the reader only reads the head
+    static const uint32_t counts[] = {0, 23, 24, 255, 256, 65535, 65536, UINT32_MAX};
+    for (uint32_t expected : counts) {
+        StringPrint out;
+        CborWriter writer(out);
+        writer.beginArray(expected);
+        writer.beginMap(expected);
+
+        CborReader reader((const uint8_t*)out.text.data(), out.text.size());
+        uint32_t count;
+        TEST_ASSERT_TRUE(reader.readArray(count));
+        TEST_ASSERT_EQUAL(expected, count);
+        TEST_ASSERT_TRUE(reader.readMap(count));
+        TEST_ASSERT_EQUAL(expected, count);
+        TEST_ASSERT_TRUE(reader.atEnd());
+    }
+
+    // Indefinite lengths are written for streams, the reader rejects them
+        StringPrint out;
+        CborWriter writer(out);
+        writer.beginIndefiniteArray();
+        writer.writeUint(1);
+        writer.end();
+        TEST_ASSERT_EQUAL(0, memcmp("\x9F\x01\xFF", out.text.data(), 3));
+
+        CborReader reader((const uint8_t*)out.text.data(), out.text.size());
+        uint32_t count;
+        TEST_ASSERT_FALSE(reader.readArray(count));
+        TEST_ASSERT_FALSE(reader.ok());
+}
+
+void test_nested_round_trip() {
+    std::string data = encodeDocument();
+    TEST_ASSERT_TRUE(decodeDocument(data));
+
+    // Trailing data is left for the caller
+    TEST_ASSERT_FALSE(decodeDocument(data + '\x00'));
+}
+
+void test_truncated_input() {
+    std::string data = encodeDocument();
+
+    // Every prefix fails. The copy is exactly as long as the prefix, so reading past it would show up in
+    // a memory checker (and in the decoded values).
+    for (size_t length = 0; length < data.size(); length++) {
+        std::string prefix(data, 0, length);
+        char message[48];
+        snprintf(message, sizeof(message), "Truncated to %u bytes", (unsigned)length);
+        TEST_ASSERT_FALSE_MESSAGE(decodeDocument(prefix), message);
+    }
+
+    // Once an item failed, every following read fails too
+        CborReader reader((const uint8_t*)"\x19\x01", 2);
+        uint32_t value;
+        TEST_ASSERT_FALSE(reader.readUint(value));
+        TEST_ASSERT_FALSE(reader.readUint(value));
+        TEST_ASSERT_FALSE(reader.ok());
+}
+
+void test_malformed_input() {
+    uint32_t value;
+    char text[8];
+
+    // Reserved additional information (28 to 30)
+        CborReader reserved((const uint8_t*)"\x1C\x00", 2);
+        TEST_ASSERT_FALSE(reserved.readUint(value));
+
+    // Wrong major type
+        CborReader wrongType((const uint8_t*)"\x61\x61", 2);
+        TEST_ASSERT_FALSE(wrongType.readUint(value));
+
+    // String longer than the data, and longer than the buffer
+        CborReader overlong((const uint8_t*)"\x78\xFF\x61", 3);
+        TEST_ASSERT_FALSE(overlong.readString(text, sizeof(text)));
+        CborReader tooLarge((const uint8_t*)"\x68" "abcdefgh", 9);
+        TEST_ASSERT_FALSE(tooLarge.readString(text, sizeof(text))); // No room for the terminator
+        CborReader fits((const uint8_t*)"\x67" "abcdefg", 8);
+        TEST_ASSERT_TRUE(fits.readString(text, sizeof(text)));
+        TEST_ASSERT_EQUAL_STRING("abcdefg", text);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_head_sizes);
+    RUN_TEST(test_container_lengths);
+    RUN_TEST(test_nested_round_trip);
+    RUN_TEST(test_truncated_input);
+    RUN_TEST(test_malformed_input);
+    return UNITY_END();
+}
@@ -0,0 +1,89 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include <dose_log.hpp>
+// Dose log tests (native only):
+//  - Compaction once the log is full: sequence numbers stay valid, the log is replaced by a rename.
+//  - A compaction that fails (flash full) keeps the log and is only retried after DOSE_LOG_COMPACT_RETRY entries.
+
+#define LOG_PATH "/doses.log"
+#define TEMP_PATH "/doses.tmp"
+
+extern DoseLogClass doseLog;
+
+// Fills the log to the capacity, compartment = sequence % 256 to check the content
+static void fill() {
+    for (uint32_t i = 0; i < DOSE_LOG_CAPACITY; i++) {
+        doseLog.append(DoseEvent::TAKEN, i % 256);
+    }
+}
+
+void setUp() {
+    LittleFS.format();
+    LittleFS.failWrites = "";
+    doseLog.begin();
+}
+
+void tearDown() {
+    LittleFS.failWrites = "";
+}
+
+void test_compaction_keeps_sequence_numbers() {
+    fill();
+    TEST_ASSERT_EQUAL(0, doseLog.firstSequence());
+    TEST_ASSERT_EQUAL(DOSE_LOG_CAPACITY, doseLog.nextSequence());
+
+    // The next entry drops the oldest half
+        doseLog.append(DoseEvent::DUE, 7);
+        TEST_ASSERT_EQUAL(DOSE_LOG_CAPACITY / 2, doseLog.firstSequence());
+        TEST_ASSERT_EQUAL(DOSE_LOG_CAPACITY + 1, doseLog.nextSequence());
+        TEST_ASSERT_FALSE(LittleFS.exists(TEMP_PATH));
+
+    // Entries are read by their old sequence numbers
+        DoseLogEntry entries[4];
+        TEST_ASSERT_EQUAL(4, doseLog.read(DOSE_LOG_CAPACITY / 2, entries, 4));
+        for (uint32_t i = 0; i < 4; i++) {
+            TEST_ASSERT_EQUAL((DOSE_LOG_CAPACITY / 2 + i) % 256, entries[i].compartment);
+        }
+        TEST_ASSERT_EQUAL(1, doseLog.read(DOSE_LOG_CAPACITY, entries, 4));
+        TEST_ASSERT_EQUAL((int)DoseEvent::DUE, entries[0].event);
+        TEST_ASSERT_EQUAL(7, entries[0].compartment);
+
+    // The stored log is complete after a reboot
+        DoseLogClass rebooted;
+        rebooted.begin();
+        TEST_ASSERT_EQUAL(DOSE_LOG_CAPACITY / 2, rebooted.firstSequence());
+        TEST_ASSERT_EQUAL(DOSE_LOG_CAPACITY + 1, rebooted.nextSequence());
+}
+
+void test_failed_compaction_retries_later() {
+    fill();
+
+    // The temporary file can't be written: the log stays as it is and keeps growing
+        LittleFS.failWrites = TEMP_PATH;
+        doseLog.append(DoseEvent::DUE, 1);
+        TEST_ASSERT_EQUAL(0, doseLog.firstSequence());
+        TEST_ASSERT_EQUAL(DOSE_LOG_CAPACITY + 1, doseLog.nextSequence());
+
+    // No new attempt on the next appends
+        LittleFS.failWrites = "";
+        for (uint32_t i = 1; i < DOSE_LOG_COMPACT_RETRY; i++) {
+            doseLog.append(DoseEvent::DUE, 1);
+        }
+        TEST_ASSERT_EQUAL(0, doseLog.firstSequence());
+        TEST_ASSERT_EQUAL(DOSE_LOG_CAPACITY + DOSE_LOG_COMPACT_RETRY, doseLog.nextSequence());
+
+    // Until DOSE_LOG_COMPACT_RETRY entries later
+        doseLog.append(DoseEvent::DUE, 1);
+        uint32_t stored = DOSE_LOG_CAPACITY + DOSE_LOG_COMPACT_RETRY;
+        TEST_ASSERT_EQUAL(stored / 2, doseLog.firstSequence());
+        TEST_ASSERT_EQUAL(stored + 1, doseLog.nextSequence());
+        TEST_ASSERT_FALSE(LittleFS.exists(TEMP_PATH));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_compaction_keeps_sequence_numbers);
+    RUN_TEST(test_failed_compaction_retries_later);
+    return UNITY_END();
+}
@@ -0,0 +1,171 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <expander.hpp>
+// Compartment scan tests against fake MCP23017s (native only):
+//  - Configuration, open compartment bitmask and interrupt clearing.
+//  - Scan latency as the compartment count grows. The fake bus takes as long as the transfers would on the real
+//    400 kHz I2C bus, so the scan time ExpanderClass measures itself is the time it would spend on the bus.
+
+// MCP23017 registers used by the fake (IOCON.BANK = 0)
+#define FAKE_REG_GPINTENA 0x04
+#define FAKE_REG_INTCONA  0x08
+#define FAKE_REG_IOCON    0x0A
+#define FAKE_REG_GPIOA    0x12
+#define FAKE_REG_COUNT    0x16
+
+#define I2C_BYTE_US 22.5  // 9 bits at 400 kHz
+#define I2C_FRAME_US 5.0  // Start / repeated start and stop conditions
+
+class FakeMcp23017Bus : public ExpanderBus {
+public:
+    FakeMcp23017Bus(uint8_t p_chips) : chips(p_chips) {}
+
+    bool probe(uint8_t address) override {
+        transfer(1);
+        return chip(address) >= 0;
+    }
+
+    bool writeRegisters(uint8_t address, uint8_t reg, const uint8_t* values, uint8_t length) override {
+        transfer(2 + length);
+        int c = chip(address);
+        if (c < 0) return false;
+        for (uint8_t i = 0; i < length && reg + i < FAKE_REG_COUNT; i++) {
+            registers[c][reg + i] = values[i];
+        }
+        return true;
+    }
+
+    bool readRegisters(uint8_t address, uint8_t reg, uint8_t* values, uint8_t length) override {
+        transfer(2);          // Address and register
+        transfer(1 + length); // Repeated start, address and the data
+        int c = chip(address);
+        if (c < 0) return false;
+        for (uint8_t i = 0; i < length; i++) {
+            uint8_t r = reg + i;
+            if (r == FAKE_REG_GPIOA || r == FAKE_REG_GPIOA + 1) {
+                values[i] = pins[c] >> ((r - FAKE_REG_GPIOA) * 8);
+                interrupt[c] = false; // Reading the port clears the interrupt
+            } else {
+                values[i] = r < FAKE_REG_COUNT ? registers[c][r] : 0;
+            }
+        }
+        return true;
+    }
+
+    // Opens / closes a compartment, a change of an enabled pin raises the interrupt
+    void setCompartment(uint8_t compartment, bool open) {
+        int c = compartment / EXPANDER_PINS;
+        uint16_t bit = 1 << (compartment % EXPANDER_PINS);
+        uint16_t previous = pins[c];
+        pins[c] = open ? pins[c] | bit : pins[c] & ~bit;
+        uint16_t enabled = registers[c][FAKE_REG_GPINTENA] | registers[c][FAKE_REG_GPINTENA + 1] << 8;
+        if ((previous ^ pins[c]) & enabled & bit) interrupt[c] = true;
+    }
+
+    bool interruptLine() { // Wired OR of the open drain outputs
+        for (uint8_t c = 0; c < chips; c++) {
+            if (interrupt[c]) return true;
+        }
+        return false;
+    }
+
+    uint8_t chips;
+    uint8_t registers[MAX_EXPANDERS][FAKE_REG_COUNT] = {};
+    uint16_t pins[MAX_EXPANDERS] = {};
+    bool interrupt[MAX_EXPANDERS] = {};
+    double busUs = 0; // Bus time of all transfers so far
+
+private:
+    int chip(uint8_t address) {
+        int c = address - EXPANDER_BASE_ADDRESS;
+        return c >= 0 && c < chips ? c : -1;
+    }
+
+    // Takes as long as the transfer on the bus
+    void transfer(uint8_t bytes) {
+        double us = I2C_FRAME_US + bytes * I2C_BYTE_US;
+        busUs += us;
+        int64_t end = esp_timer_get_time() + (int64_t)(us + 0.5);
+        while (esp_timer_get_time() < end) {}
+    }
+};
+
+void setUp() {}
+void tearDown() {}
+
+void test_no_expanders() {
+    FakeMcp23017Bus bus(0);
+    ExpanderClass expander(bus);
+    TEST_ASSERT_EQUAL(0, expander.begin());
+    TEST_ASSERT_EQUAL(0, expander.scan());
+}
+
+void test_configuration() {
+    FakeMcp23017Bus bus(MAX_EXPANDERS);
+    ExpanderClass expander(bus);
+    TEST_ASSERT_EQUAL(MAX_COMPARTMENTS, expander.begin());
+
+    for (uint8_t c = 0; c < MAX_EXPANDERS; c++) {
+        TEST_ASSERT_EQUAL(0x44, bus.registers[c][FAKE_REG_IOCON]); // Mirrored, open drain
+        TEST_ASSERT_EQUAL(0x00, bus.registers[c][FAKE_REG_INTCONA]); // Compare against the previous value
+
+        // Interrupts only on the pins that have a compartment
+        uint8_t used = MAX_COMPARTMENTS - c * EXPANDER_PINS;
+        uint16_t mask = used >= EXPANDER_PINS ? 0xFFFF : (1 << used) - 1;
+        TEST_ASSERT_EQUAL(mask & 0xFF, bus.registers[c][FAKE_REG_GPINTENA]);
+        TEST_ASSERT_EQUAL(mask >> 8, bus.registers[c][FAKE_REG_GPINTENA + 1]);
+    }
+}
+
+void test_scan_reads_compartments() {
+    FakeMcp23017Bus bus(MAX_EXPANDERS);
+    ExpanderClass expander(bus);
+    expander.begin();
+
+    bus.setCompartment(3, true);
+    bus.setCompartment(MAX_COMPARTMENTS - 1, true);
+    TEST_ASSERT_TRUE(bus.interruptLine());
+    TEST_ASSERT_EQUAL((1UL << 3) | (1UL << (MAX_COMPARTMENTS - 1)), expander.scan());
+    TEST_ASSERT_FALSE(bus.interruptLine()); // The scan cleared it
+
+    bus.setCompartment(3, false);
+    TEST_ASSERT_EQUAL(1UL << (MAX_COMPARTMENTS - 1), expander.scan());
+}
+
+void test_scan_latency() {
+    printf("Scan latency (400 kHz I2C):\n");
+    printf(" %8s %12s %12s %12s\n", "chips", "compartments", "bus (us)", "scan (us)");
+
+    double perChipUs = 0;
+    for (uint8_t chips = 1; chips <= MAX_EXPANDERS; chips++) {
+        FakeMcp23017Bus bus(chips);
+        ExpanderClass expander(bus);
+        uint8_t compartments = expander.begin();
+
+        // Fastest of a few scans, the host may preempt any single one
+        uint32_t fastest = UINT32_MAX;
+        double scanBusUs = 0;
+        for (int i = 0; i < 20; i++) {
+            double before = bus.busUs;
+            expander.scan();
+            scanBusUs = bus.busUs - before;
+            if (expander.lastScanUs < fastest) fastest = expander.lastScanUs;
+        }
+        printf(" %8u %12u %12.0f %12u\n", chips, compartments, scanBusUs, (unsigned)fastest);
+
+        // One read transaction per chip, the scan time grows linearly with the chips
+        if (chips == 1) perChipUs = scanBusUs;
+        TEST_ASSERT_EQUAL((int)(perChipUs * chips + 0.5), (int)(scanBusUs + 0.5));
+        TEST_ASSERT_GREATER_OR_EQUAL((uint32_t)scanBusUs, fastest);
+        TEST_ASSERT_LESS_OR_EQUAL((uint32_t)(scanBusUs * 1.5 + 20), fastest);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_no_expanders);
+    RUN_TEST(test_configuration);
+    RUN_TEST(test_scan_reads_compartments);
+    RUN_TEST(test_scan_latency);
+    return UNITY_END();
+}
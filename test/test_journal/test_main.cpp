@@ -0,0 +1,176 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <LittleFS.h>
+#include <esp_system.h>
+#include <journal.hpp>
+#include <string>
+// Alert journal crash tests (native only, built with JOURNAL_FAULT_INJECTION):
+//  - A sequence of transitions (enough for two compactions, with flash checkpoints in between) is run again and
+//    again, crashing at write point N for every N until it completes. Each crash is followed by a boot on the same
+//    journal storage, which has to recover the state before or after the interrupted transition.
+//  - A power on after the crash loses the RTC memory, the state comes from the last flash checkpoint.
+//  - The write cost of a transition (stores, bytes and time) is printed from the journal's own counters.
+
+#define SEQUENCE_LENGTH 80    // Transitions, more than two journal rings
+#define CHECKPOINT_EVERY 10   // Transitions between two flash checkpoints
+#define GARBAGE_BYTE 0xA5     // RTC memory content after power on
+
+static JournalStorage storage;
+
+// Collects everything written to it
+class StringPrint : public Print {
+public:
+    std::string text;
+    size_t write(uint8_t c) override {
+        text += (char)c;
+        return 1;
+    }
+};
+
+void setUp() {
+    LittleFS.format();
+    memset(&storage, GARBAGE_BYTE, sizeof(storage));
+    shimResetReason = ESP_RST_POWERON;
+}
+
+void tearDown() {}
+
+// Transition i of the sequence, every one changes its field
+static void transition(uint32_t i, JournalField& field, uint32_t& value) {
+    switch (i % 3) {
+        case 0: field = JournalField::OUTPUT_STATE; value = 1 + (i / 3) % 6; break;
+        case 1: field = JournalField::DUE_COMPARTMENTS; value = 0x1000 + i; break;
+        default: field = JournalField::SLEEP_COUNTER; value = i; break;
+    }
+}
+
+static void apply(JournalState& state, JournalField field, uint32_t value) {
+    switch (field) {
+        case JournalField::OUTPUT_STATE: state.outputState = value; break;
+        case JournalField::DUE_COMPARTMENTS: state.dueCompartments = value; break;
+        case JournalField::SLEEP_COUNTER: state.sleepCounter = value; break;
+    }
+}
+
+static bool sameState(const JournalState& a, const JournalState& b) {
+    return a.outputState == b.outputState && a.dueCompartments == b.dueCompartments && a.sleepCounter == b.sleepCounter;
+}
+
+void test_recovers_without_fault() {
+    JournalClass first(&storage);
+    first.begin();
+    TEST_ASSERT_EQUAL((int)JournalSource::NONE, (int)first.source());
+
+    JournalState expected = {};
+    for (uint32_t i = 0; i < SEQUENCE_LENGTH; i++) {
+        JournalField field;
+        uint32_t value;
+        transition(i, field, value);
+        first.record(field, value);
+        apply(expected, field, value);
+    }
+
+    // Write cost of the transitions: one record each, a base snapshot every JOURNAL_RING_SIZE (time in host ns)
+        StringPrint json;
+        first.exportJson(json);
+        unsigned writes, meanCycles, maxCycles, compactions;
+        const char* costs = strstr(json.text.c_str(), "\"writes\":");
+        TEST_ASSERT_NOT_NULL(costs);
+        TEST_ASSERT_EQUAL(4, sscanf(costs, "\"writes\":%u,\"meanWriteCycles\":%u,\"maxWriteCycles\":%u,\"compactions\":%u",
+            &writes, &meanCycles, &maxCycles, &compactions));
+        TEST_ASSERT_EQUAL(SEQUENCE_LENGTH, writes);
+
+        double bytes = sizeof(JournalRecord) + (double)compactions * sizeof(JournalBase) / writes;
+        printf("Journal write cost per transition: 2 stores (%u bytes), %.1f bytes with the %u base snapshots, "
+            "%u ns mean, %u ns max\n", (unsigned)sizeof(JournalRecord), bytes, compactions, meanCycles, maxCycles);
+
+    shimResetReason = ESP_RST_PANIC;
+    JournalClass second(&storage);
+    second.begin();
+    TEST_ASSERT_EQUAL((int)JournalSource::RTC, (int)second.source());
+    TEST_ASSERT_TRUE(sameState(expected, second.state()));
+    TEST_ASSERT_EQUAL_STRING("none", second.faultCheckResult());
+}
+
+void test_crash_at_every_write_point() {
+    uint32_t writePoint = 1;
+    uint32_t flashRecoveries = 0;
+
+    for (;; writePoint++) {
+        setUp();
+
+        // Boot, then run the sequence until the armed write point resets the device
+            JournalClass crashing(&storage);
+            crashing.begin();
+            crashing.armFault(writePoint);
+
+            JournalState before = {};
+            JournalState after = {};
+            JournalState durable = {}; // Last flash checkpoint
+            bool crashed = false;
+            for (uint32_t i = 0; i < SEQUENCE_LENGTH && !crashed; i++) {
+                JournalField field;
+                uint32_t value;
+                transition(i, field, value);
+                before = after;
+                apply(after, field, value);
+                try {
+                    crashing.record(field, value);
+                } catch (const ShimRestart&) {
+                    crashed = true;
+                    break;
+                }
+
+                if ((i + 1) % CHECKPOINT_EVERY == 0) {
+                    crashing.checkpoint();
+                    durable = after;
+                    durable.sleepCounter = 0;
+                }
+            }
+            if (!crashed) break; // Past the last write point of the sequence
+
+        // Reset: RTC memory survives, the interrupted transition happened entirely or not at all
+            shimResetReason = ESP_RST_SW;
+            JournalClass recovered(&storage);
+            recovered.begin();
+
+            char message[64];
+            snprintf(message, sizeof(message), "Crash at write point %u", (unsigned)writePoint);
+            TEST_ASSERT_EQUAL_MESSAGE((int)JournalSource::RTC, (int)recovered.source(), message);
+            TEST_ASSERT_TRUE_MESSAGE(sameState(recovered.state(), before) || sameState(recovered.state(), after), message);
+            TEST_ASSERT_EQUAL_STRING_MESSAGE("pass", recovered.faultCheckResult(), message);
+
+        // The recovered journal keeps working
+            recovered.record(JournalField::DUE_COMPARTMENTS, 0xBEEF);
+            JournalState continued = recovered.state();
+            JournalClass again(&storage);
+            again.begin();
+            TEST_ASSERT_TRUE_MESSAGE(sameState(again.state(), continued), message);
+
+        // Power on: RTC memory is garbage, the flash checkpoint is all that is left
+            memset(&storage, GARBAGE_BYTE, sizeof(storage));
+            shimResetReason = ESP_RST_POWERON;
+            JournalClass powered(&storage);
+            powered.begin();
+            if (durable.dueCompartments != 0) {
+                TEST_ASSERT_EQUAL_MESSAGE((int)JournalSource::FLASH, (int)powered.source(), message);
+                flashRecoveries++;
+            } else {
+                TEST_ASSERT_EQUAL_MESSAGE((int)JournalSource::NONE, (int)powered.source(), message);
+            }
+            TEST_ASSERT_TRUE_MESSAGE(sameState(powered.state(), durable), message);
+    }
+
+    // Two write points per transition and one per compaction
+    printf("Journal: %u write points checked, %u power on recoveries from flash\n",
+        (unsigned)(writePoint - 1), (unsigned)flashRecoveries);
+    TEST_ASSERT_EQUAL(2 * SEQUENCE_LENGTH + 2, writePoint - 1);
+    TEST_ASSERT_TRUE(flashRecoveries > 0);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_recovers_without_fault);
+    RUN_TEST(test_crash_at_every_write_point);
+    return UNITY_END();
+}
@@ -0,0 +1,231 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <math.h>
+#include <led.hpp>
+#include <output.hpp>
+// LED renderer tests (native only):
+//  - Keyframe sampling (interpolation, hue wrap, loop and hold) and the gamma table.
+//  - Change detection of submit(), the corrected frame decides if the strip needs a transfer.
+//  - The frame sequence of the output worker, state by state at its 10 ms pace: how many frames are composed,
+//    how many change and get pushed. The LED task does not run on the host, the test pushes every changed frame.
+
+#define SIM_STEP_MS 10        // WORKER_TASK_DELAY_MS
+#define SIM_BREATH_STEP_MS 40 // BREATH_STEP_MS
+#define SIM_SHORTEST_BUZZ_MS 500 // BUZZ_PHASE4_INTERVAL
+#define SIM_STATE_MS 8000     // Time spent in each state, two breaths of the slowest phase
+#define SIM_COMPARTMENTS 4
+#define SIM_DUE 0x5           // Compartments 0 and 2
+#define SIM_SOC 60
+
+void setUp() {}
+void tearDown() {}
+
+static const LedKeyframe rampKeyframes[] = {{0, HUE_RED, 255, 0}, {100, HUE_RED, 255, 200}};
+
+void test_sample_holds_after_last_keyframe() {
+    LedAnimation once = {rampKeyframes, 2, 0};
+    TEST_ASSERT_EQUAL(0, LedClass::sample(once, 0).val);
+    TEST_ASSERT_EQUAL(100, LedClass::sample(once, 50).val);
+    TEST_ASSERT_EQUAL(200, LedClass::sample(once, 100).val);
+    TEST_ASSERT_EQUAL(200, LedClass::sample(once, 5000).val);
+}
+
+void test_sample_loops_back_to_first_keyframe() {
+    LedAnimation loop = {rampKeyframes, 2, 200};
+    TEST_ASSERT_EQUAL(200, LedClass::sample(loop, 100).val);
+    TEST_ASSERT_EQUAL(100, LedClass::sample(loop, 150).val); // Fading back
+    TEST_ASSERT_EQUAL(0, LedClass::sample(loop, 200).val);
+    TEST_ASSERT_EQUAL(100, LedClass::sample(loop, 250).val);
+}
+
+void test_sample_hue_takes_shorter_way() {
+    // 240 to 16 crosses red (0), not green
+    static const LedKeyframe wrap[] = {{0, 240, 255, 255}, {100, 16, 255, 255}};
+    LedAnimation animation = {wrap, 2, 0};
+    TEST_ASSERT_EQUAL(0, LedClass::sample(animation, 50).hue);
+    TEST_ASSERT_EQUAL(248, LedClass::sample(animation, 25).hue);
+}
+
+void test_gamma_table() {
+    TEST_ASSERT_EQUAL(0, LedClass::gamma(0));
+    TEST_ASSERT_EQUAL(255, LedClass::gamma(255));
+    for (int i = 1; i < 256; i++) {
+        TEST_ASSERT_TRUE(LedClass::gamma(i) >= LedClass::gamma(i - 1));
+
+        // Within a few levels of a true 2.2 curve
+        double expected = pow(i / 255.0, 2.2) * 255;
+        TEST_ASSERT_TRUE(fabs(LedClass::gamma(i) - expected) <= 3);
+    }
+}
+
+void test_submit_change_detection() {
+    LedClass strip;
+    strip.begin();
+    strip.setPixelCount(3);
+
+    CRGB frame[3];
+    TEST_ASSERT_FALSE(strip.submit(frame, 0)); // Black, like the strip after begin()
+
+    frame[1] = CRGB::Red;
+    TEST_ASSERT_TRUE(strip.submit(frame, 0));
+    TEST_ASSERT_FALSE(strip.submit(frame, 0));
+
+    frame[1] = CRGB::Blue;
+    TEST_ASSERT_TRUE(strip.submit(frame, 0));
+
+    // Levels that gamma maps to the same output are no change (dim levels stay lit at level 1)
+    frame[2] = CRGB(2, 2, 2);
+    TEST_ASSERT_TRUE(strip.submit(frame, 0));
+    frame[2] = CRGB(3, 3, 3);
+    TEST_ASSERT_FALSE(strip.submit(frame, 0));
+
+    // Same frame, different brightness
+    strip.setBrightness(128);
+    TEST_ASSERT_TRUE(strip.submit(frame, 1));
+
+    // Pixels beyond the count are not compared
+    strip.setPixelCount(1);
+    frame[2] = CRGB::White;
+    TEST_ASSERT_FALSE(strip.submit(frame, 1));
+
+    TEST_ASSERT_EQUAL(6, strip.frameStats(0).composed);
+    TEST_ASSERT_EQUAL(3, strip.frameStats(0).changed);
+    TEST_ASSERT_EQUAL(2, strip.frameStats(1).composed);
+    TEST_ASSERT_EQUAL(1, strip.frameStats(1).changed);
+
+    uint32_t shows = FastLED.shows;
+    strip.push();
+    TEST_ASSERT_EQUAL(shows + 1, FastLED.shows);
+    TEST_ASSERT_EQUAL(1, strip.frameStats(1).pushed); // Counted for the tag of the pending frame
+}
+
+void test_breathing_peaks_at_buzz() {
+    static const OutputState phases[] = {
+        OutputState::NOTIFICATION_PHASE_1, OutputState::NOTIFICATION_PHASE_2,
+        OutputState::NOTIFICATION_PHASE_3, OutputState::NOTIFICATION_PHASE_4
+    };
+
+    for (OutputState state : phases) {
+        // Enter the phase at an odd time, the breath must follow the buzz and not the state change
+        OutputPattern pattern;
+        unsigned long stateStart = 100003;
+        pattern.lastBuzzTime = stateStart - 1234;
+
+        uint32_t brightestSum = 0;
+        uint32_t sumAtBuzz = 0;
+        for (unsigned long t = stateStart; t < stateStart + SIM_STATE_MS; t += SIM_STEP_MS) {
+            bool wasBuzzing = pattern.buzzActive;
+            OutputLevels levels = OuptutClass::patternStep(state, t, 200, 100, pattern);
+
+            CRGB frame[LED_MAX_PIXELS];
+            OuptutClass::renderFrame(frame, state, 0, 0, t - stateStart, t - pattern.lastBuzzTime, SIM_SOC);
+            uint32_t sum = frame[0].r + frame[0].g + frame[0].b;
+            if (sum > brightestSum) brightestSum = sum;
+
+            if (levels.vibe && !wasBuzzing) {
+                if (sumAtBuzz != 0) TEST_ASSERT_EQUAL(sumAtBuzz, sum); // Every buzz, same phase of the breath
+                sumAtBuzz = sum;
+            }
+        }
+
+        TEST_ASSERT_TRUE(sumAtBuzz > 0);
+        TEST_ASSERT_EQUAL(brightestSum, sumAtBuzz);
+    }
+}
+
+void test_low_battery_warning() {
+    CRGB frame[LED_MAX_PIXELS];
+
+    // SAVING and above: the status pixel stays dark while awake
+        OuptutClass::renderFrame(frame, OutputState::ON, 0, 0, 150, 0, 25);
+        TEST_ASSERT_EQUAL(0, frame[0].r + frame[0].g + frame[0].b);
+
+    // LOW_BATTERY: a short red flash every 4 s, dark in between
+        OuptutClass::renderFrame(frame, OutputState::ON, 0, 0, 150, 0, 24);
+        TEST_ASSERT_TRUE(frame[0].r > 200);
+        TEST_ASSERT_EQUAL(0, frame[0].g + frame[0].b);
+        OuptutClass::renderFrame(frame, OutputState::ON, 0, 0, 2000, 0, 24);
+        TEST_ASSERT_EQUAL(0, frame[0].r + frame[0].g + frame[0].b);
+        OuptutClass::renderFrame(frame, OutputState::ON, 0, 0, 4150, 0, 5);
+        TEST_ASSERT_TRUE(frame[0].r > 200);
+
+    // The gauge of the open hatch is red as well
+        OuptutClass::renderFrame(frame, OutputState::HATCH_OPEN, 0, 0, 300, 0, 5);
+        TEST_ASSERT_TRUE(frame[0].r > 200);
+        TEST_ASSERT_TRUE(frame[0].g < 64);
+}
+
+void test_frame_sequence() {
+    static const OutputState states[] = {
+        OutputState::OFF, OutputState::ON, OutputState::HATCH_OPEN,
+        OutputState::NOTIFICATION_PHASE_1, OutputState::NOTIFICATION_PHASE_2,
+        OutputState::NOTIFICATION_PHASE_3, OutputState::NOTIFICATION_PHASE_4
+    };
+    static const char* names[] = {"OFF", "ON", "HATCH_OPEN", "PHASE_1", "PHASE_2", "PHASE_3", "PHASE_4"};
+
+    LedClass strip;
+    strip.begin();
+    strip.setPixelCount(1 + SIM_COMPARTMENTS);
+    uint32_t shows = FastLED.shows;
+
+    // The output worker loop, without the GPIOs
+    OutputPattern pattern;
+    unsigned long t = 100000;
+    for (OutputState state : states) {
+        unsigned long stateStart = t;
+        unsigned long lastChange = t;
+        for (; t < stateStart + SIM_STATE_MS; t += SIM_STEP_MS) {
+            OuptutClass::patternStep(state, t, 200, 100, pattern);
+
+            CRGB frame[LED_MAX_PIXELS];
+            OuptutClass::renderFrame(frame, state, SIM_DUE, SIM_COMPARTMENTS, t - stateStart, t - pattern.lastBuzzTime, SIM_SOC);
+            if (strip.submit(frame, (uint8_t)state)) {
+                strip.push();
+                lastChange = t;
+            }
+        }
+
+        // Static states settle: the hatch gauge after its 300 ms fade in, OFF and ON right away
+        if (state == OutputState::OFF || state == OutputState::ON || state == OutputState::HATCH_OPEN) {
+            TEST_ASSERT_TRUE(lastChange - stateStart <= 300);
+        }
+    }
+
+    printf("Frames per state (%u s at %u ms):\n", SIM_STATE_MS / 1000, SIM_STEP_MS);
+    printf(" %12s %10s %10s %10s\n", "state", "composed", "changed", "pushed");
+    uint32_t pushed = 0;
+    for (OutputState state : states) {
+        const LedFrameStats& stats = strip.frameStats((uint8_t)state);
+        printf(" %12s %10u %10u %10u\n", names[(int)state], (unsigned)stats.composed, (unsigned)stats.changed, (unsigned)stats.pushed);
+
+        TEST_ASSERT_EQUAL(SIM_STATE_MS / SIM_STEP_MS, stats.composed);
+        TEST_ASSERT_EQUAL(stats.changed, stats.pushed);
+        pushed += stats.pushed;
+    }
+    TEST_ASSERT_EQUAL(shows + pushed, FastLED.shows);
+
+    // OFF is all black like the strip after begin(), ON lights the due compartments once
+    TEST_ASSERT_EQUAL(0, strip.frameStats((uint8_t)OutputState::OFF).pushed);
+    TEST_ASSERT_EQUAL(1, strip.frameStats((uint8_t)OutputState::ON).pushed);
+    TEST_ASSERT_TRUE(strip.frameStats((uint8_t)OutputState::HATCH_OPEN).pushed <= 300 / SIM_STEP_MS + 1);
+
+    // Breathing pushes at most once per breath step, plus the jump back to the peak at every buzz
+    for (int i = (int)OutputState::NOTIFICATION_PHASE_1; i <= (int)OutputState::NOTIFICATION_PHASE_4; i++) {
+        const LedFrameStats& stats = strip.frameStats(i);
+        TEST_ASSERT_TRUE(stats.pushed <= stats.composed * SIM_STEP_MS / SIM_BREATH_STEP_MS + SIM_STATE_MS / SIM_SHORTEST_BUZZ_MS);
+        TEST_ASSERT_TRUE(stats.pushed > stats.composed * SIM_STEP_MS / SIM_BREATH_STEP_MS / 2); // Still breathing
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_sample_holds_after_last_keyframe);
+    RUN_TEST(test_sample_loops_back_to_first_keyframe);
+    RUN_TEST(test_sample_hue_takes_shorter_way);
+    RUN_TEST(test_gamma_table);
+    RUN_TEST(test_submit_change_detection);
+    RUN_TEST(test_breathing_peaks_at_buzz);
+    RUN_TEST(test_low_battery_warning);
+    RUN_TEST(test_frame_sequence);
+    return UNITY_END();
+}
@@ -0,0 +1,202 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include <esp_system.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <metrics.hpp>
+// Latency metrics tests (native only), with synthetic timings instead of the input and output tasks:
+//  - Bucket selection of record() and the percentiles reported from the buckets.
+//  - start() / stop() pairing: starts before boot (negative), starts after the stop, expired and restarted starts.
+//  - Histograms surviving a wakeup but not a power on, and the /metrics JSON.
+
+#define SECOND_US 1000000LL
+
+// Collects everything written to it
+class StringPrint : public Print {
+public:
+    std::string text;
+    size_t write(uint8_t c) override {
+        text += (char)c;
+        return 1;
+    }
+};
+
+extern MetricsClass metrics;
+
+static std::string exportJson() {
+    StringPrint out;
+    metrics.exportJson(out);
+    return out.text;
+}
+
+// JSON of a path with a single recorded latency in the given bucket
+static std::string singlePath(const char* name, uint32_t latencyUs, int bucket) {
+    char head[192];
+    snprintf(head, sizeof(head),
+        "\"%s\":{\"count\":1,\"expired\":0,\"meanUs\":%u,\"p50Us\":%u,\"p90Us\":%u,\"p99Us\":%u,\"maxUs\":%u,\"buckets\":[",
+        name, (unsigned)latencyUs, (unsigned)latencyUs, (unsigned)latencyUs, (unsigned)latencyUs, (unsigned)latencyUs);
+    std::string json = head;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        json += i == 0 ? "" : ",";
+        json += i == bucket ? "1" : "0";
+    }
+    return json + "]}";
+}
+
+static std::string emptyPath(const char* name) {
+    std::string json = std::string("\"") + name + "\":{\"count\":0,\"expired\":0,\"meanUs\":0,\"p50Us\":0,\"p90Us\":0,\"p99Us\":0,\"maxUs\":0,\"buckets\":[";
+    for (int i = 0; i < METRICS_BUCKETS; i++) json += i == 0 ? "0" : ",0";
+    return json + "]}";
+}
+
+void setUp() {
+    shimResetReason = ESP_RST_POWERON;
+    shimWakeupCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+    metrics.begin();
+}
+
+void tearDown() {}
+
+void test_record_selects_log_bucket() {
+    // Bucket N holds [2^N, 2^(N+1)), 0 shares the first bucket with 1
+    static const struct { uint32_t latencyUs; int bucket; } cases[] = {
+        {0, 0}, {1, 0}, {2, 1}, {3, 1}, {4, 2}, {1023, 9}, {1024, 10}, {METRICS_PENDING_TIMEOUT_US, 23}, {UINT32_MAX, 31}
+    };
+
+    for (const auto& c : cases) {
+        setUp();
+        metrics.record(LatencyPath::HTTP_REQUEST, c.latencyUs);
+        std::string json = exportJson();
+        std::string expected = singlePath("httpRequest", c.latencyUs, c.bucket);
+
+        char message[64];
+        snprintf(message, sizeof(message), "Latency %u us", (unsigned)c.latencyUs);
+        TEST_ASSERT_TRUE_MESSAGE(json.find(expected) != std::string::npos, message);
+    }
+}
+
+void test_percentile_reports_bucket_upper_bound() {
+    TEST_ASSERT_EQUAL(0, metrics.percentile(LatencyPath::HATCH_TO_OUTPUT, 50)); // Empty
+
+    // 90 fast, 9 slow and one very slow reaction
+    for (int i = 0; i < 90; i++) metrics.record(LatencyPath::HATCH_TO_OUTPUT, 100);    // Bucket 6, up to 127
+    for (int i = 0; i < 9; i++) metrics.record(LatencyPath::HATCH_TO_OUTPUT, 5000);    // Bucket 12, up to 8191
+    metrics.record(LatencyPath::HATCH_TO_OUTPUT, 200000);                              // Bucket 17
+
+    TEST_ASSERT_EQUAL(127, metrics.percentile(LatencyPath::HATCH_TO_OUTPUT, 0));
+    TEST_ASSERT_EQUAL(127, metrics.percentile(LatencyPath::HATCH_TO_OUTPUT, 50));
+    TEST_ASSERT_EQUAL(127, metrics.percentile(LatencyPath::HATCH_TO_OUTPUT, 90));
+    TEST_ASSERT_EQUAL(8191, metrics.percentile(LatencyPath::HATCH_TO_OUTPUT, 91));
+    TEST_ASSERT_EQUAL(8191, metrics.percentile(LatencyPath::HATCH_TO_OUTPUT, 99));
+    TEST_ASSERT_EQUAL(200000, metrics.percentile(LatencyPath::HATCH_TO_OUTPUT, 100)); // Capped at the maximum
+
+    // The other paths are untouched
+    TEST_ASSERT_EQUAL(0, metrics.percentile(LatencyPath::DUE_TO_ALERT, 100));
+}
+
+void test_stop_pairs_with_pending_start() {
+    LatencyPath path = LatencyPath::HATCH_TO_OUTPUT;
+
+    // A stop without a start, and a second stop after the pair, record nothing
+        metrics.stop(path);
+        metrics.start(path);
+        metrics.stop(path);
+        metrics.stop(path);
+        TEST_ASSERT_TRUE(exportJson().find("\"hatchToOutput\":{\"count\":1,\"expired\":0,") != std::string::npos);
+        TEST_ASSERT_TRUE(metrics.percentile(path, 100) < SECOND_US);
+
+    // A second start restarts the pending measurement
+        metrics.startAt(path, esp_timer_get_time() - 5 * SECOND_US);
+        metrics.start(path);
+        metrics.stop(path);
+        TEST_ASSERT_TRUE(exportJson().find("\"hatchToOutput\":{\"count\":2,\"expired\":0,") != std::string::npos);
+        TEST_ASSERT_TRUE(metrics.percentile(path, 100) < SECOND_US);
+}
+
+void test_start_before_boot() {
+    // Due 3 s before boot (esp_timer counts from boot, so the start is negative)
+    int64_t before = esp_timer_get_time();
+    metrics.startAt(LatencyPath::DUE_TO_ALERT, -3 * SECOND_US);
+    metrics.stop(LatencyPath::DUE_TO_ALERT);
+    int64_t after = esp_timer_get_time();
+
+    uint32_t latency = metrics.percentile(LatencyPath::DUE_TO_ALERT, 100);
+    TEST_ASSERT_TRUE(latency >= 3 * SECOND_US + before);
+    TEST_ASSERT_TRUE(latency <= 3 * SECOND_US + after);
+    TEST_ASSERT_TRUE(exportJson().find("\"dueToAlert\":{\"count\":1,\"expired\":0,") != std::string::npos);
+}
+
+void test_expired_starts() {
+    int64_t now = esp_timer_get_time();
+
+    // Too long ago to belong to the reaction, whether before boot or after
+        metrics.startAt(LatencyPath::DUE_TO_ALERT, -20 * SECOND_US);
+        metrics.stop(LatencyPath::DUE_TO_ALERT);
+        metrics.startAt(LatencyPath::HATCH_TO_OUTPUT, now - METRICS_PENDING_TIMEOUT_US - SECOND_US);
+        metrics.stop(LatencyPath::HATCH_TO_OUTPUT);
+
+        std::string json = exportJson();
+        TEST_ASSERT_TRUE(json.find("\"dueToAlert\":{\"count\":0,\"expired\":1,") != std::string::npos);
+        TEST_ASSERT_TRUE(json.find("\"hatchToOutput\":{\"count\":0,\"expired\":1,") != std::string::npos);
+        TEST_ASSERT_EQUAL(0, metrics.percentile(LatencyPath::DUE_TO_ALERT, 100));
+
+    // The expired start is gone, the next stop has nothing to pair with
+        metrics.stop(LatencyPath::DUE_TO_ALERT);
+        TEST_ASSERT_TRUE(exportJson().find("\"dueToAlert\":{\"count\":0,\"expired\":1,") != std::string::npos);
+
+    // A start in the future (clock adjusted in between) counts as no latency
+        metrics.startAt(LatencyPath::HATCH_TO_OUTPUT, now + 5 * SECOND_US);
+        metrics.stop(LatencyPath::HATCH_TO_OUTPUT);
+        TEST_ASSERT_TRUE(exportJson().find("\"hatchToOutput\":{\"count\":1,\"expired\":1,\"meanUs\":0,") != std::string::npos);
+}
+
+void test_histograms_survive_wakeup() {
+    metrics.record(LatencyPath::HTTP_REQUEST, 1500);
+
+    // Timer wakeup: histograms kept, WAKE_TO_OUTPUT pending since boot
+        shimResetReason = ESP_RST_DEEPSLEEP;
+        shimWakeupCause = ESP_SLEEP_WAKEUP_TIMER;
+        metrics.begin();
+        metrics.stop(LatencyPath::WAKE_TO_OUTPUT);
+        TEST_ASSERT_EQUAL(1500, metrics.percentile(LatencyPath::HTTP_REQUEST, 100));
+        TEST_ASSERT_TRUE(exportJson().find("\"wakeToOutput\":{\"count\":1,\"expired\":0,") != std::string::npos);
+
+    // Software reset without a wakeup: nothing pending
+        shimResetReason = ESP_RST_SW;
+        shimWakeupCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+        metrics.begin();
+        metrics.stop(LatencyPath::WAKE_TO_OUTPUT);
+        TEST_ASSERT_TRUE(exportJson().find("\"wakeToOutput\":{\"count\":1,\"expired\":0,") != std::string::npos);
+
+    // Power on: RTC memory is lost
+        shimResetReason = ESP_RST_POWERON;
+        metrics.begin();
+        TEST_ASSERT_EQUAL(0, metrics.percentile(LatencyPath::HTTP_REQUEST, 100));
+}
+
+void test_export_json() {
+    TEST_ASSERT_EQUAL_STRING(("{" + emptyPath("hatchToOutput") + "," + emptyPath("dueToAlert") + "," +
+        emptyPath("wakeToOutput") + "," + emptyPath("httpRequest") + "}").c_str(), exportJson().c_str());
+
+    metrics.record(LatencyPath::DUE_TO_ALERT, 40000);
+    TEST_ASSERT_EQUAL_STRING(("{" + emptyPath("hatchToOutput") + "," + singlePath("dueToAlert", 40000, 15) + "," +
+        emptyPath("wakeToOutput") + "," + emptyPath("httpRequest") + "}").c_str(), exportJson().c_str());
+
+    // Mean and percentiles of several samples
+    metrics.record(LatencyPath::DUE_TO_ALERT, 20000);
+    std::string json = exportJson();
+    TEST_ASSERT_TRUE(json.find("\"dueToAlert\":{\"count\":2,\"expired\":0,\"meanUs\":30000,\"p50Us\":32767,\"p90Us\":40000,\"p99Us\":40000,\"maxUs\":40000,") != std::string::npos);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_record_selects_log_bucket);
+    RUN_TEST(test_percentile_reports_bucket_upper_bound);
+    RUN_TEST(test_stop_pairs_with_pending_start);
+    RUN_TEST(test_start_before_boot);
+    RUN_TEST(test_expired_starts);
+    RUN_TEST(test_histograms_survive_wakeup);
+    RUN_TEST(test_export_json);
+    return UNITY_END();
+}
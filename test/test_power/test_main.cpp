@@ -0,0 +1,212 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <power.hpp>
+#include <server.hpp>
+#include <esp_system.h>
+// Power governor tests (native only):
+//  - Tier selection with hysteresis and the NTP attempt rate limit.
+//  - The tier surviving deep sleep, so the hysteresis also works from one wakeup to the next.
+//  - A discharge simulation that runs the battery flat twice, once with the governor and once stuck in NORMAL,
+//    and reports how much runtime each tier adds. It uses voltageToSoc (with ADC noise), selectTier and ntpSyncDue.
+
+// Load model, rough figures of the ESP32 and its peripherals, only the differences between the tiers matter
+#define SIM_CAPACITY_MAH 1000.0
+#define SIM_WAKES_PER_DAY 4      // One per scheduled dose
+#define SIM_AWAKE_S 120          // Alert, hatch open and the sleep delay
+#define SIM_ALERT_S 60           // Of the awake time, buzzing in NOTIFICATION_PHASE_1
+#define SIM_SLEEP_MA 0.15        // Deep sleep, including the regulator and the expanders
+#define SIM_CPU_MA 40.0          // Awake without radio
+#define SIM_INPUT_MA 10.0        // Input sampling every 100 ms, scales with the interval
+#define SIM_AP_MA 80.0           // Access point running
+#define SIM_LED_MA 40.0          // Per lit WS2812B pixel at full brightness (status + due compartment)
+#define SIM_VIBE_MA 90.0         // Vibration motor while it runs
+#define SIM_NTP_S 5              // WiFi connect and NTP exchange
+#define SIM_NTP_MA 130.0
+#define SIM_ADC_NOISE_V 0.02f    // Peak noise of a battery voltage reading
+#define SIM_BOOT_SAMPLES 16      // BOOT_VOLTAGE_SAMPLES
+
+struct SimResult {
+    double bandHours[4];  // Hours the true state of charge spent in the SoC band of each tier
+    double runtimeHours;
+    uint32_t tierChanges;
+    uint32_t ntpAttempts;
+};
+
+// Resting voltage of a state of charge, the inverse of voltageToSoc
+static float socToVoltage(double soc) {
+    float low = 3.3f, high = 4.2f;
+    for (int i = 0; i < 30; i++) {
+        float mid = (low + high) / 2;
+        if (PowerClass::voltageToSoc(mid) < soc) low = mid;
+        else high = mid;
+    }
+    return high;
+}
+
+// Charge (mAh) used by one wake cycle: awake time in the tier plus deep sleep until the next dose
+static double cycleCharge(const PowerPolicy& p, bool ntpAttempt) {
+    double awakeMa = SIM_CPU_MA + SIM_INPUT_MA * 100 / p.inputIntervalMs + 2 * SIM_LED_MA * p.ledBrightness / 255;
+    if (p.accessPointEnabled) awakeMa += SIM_AP_MA;
+    double vibeDuty = 200.0 * p.alertDutyPercent / 100 / 4000; // Phase 1: one buzz every 4 s
+    double mAs = awakeMa * SIM_AWAKE_S + SIM_VIBE_MA * vibeDuty * SIM_ALERT_S;
+    if (ntpAttempt) mAs += SIM_NTP_MA * SIM_NTP_S;
+    mAs += SIM_SLEEP_MA * (24 * 3600 / SIM_WAKES_PER_DAY - SIM_AWAKE_S);
+    return mAs / 3600;
+}
+
+static SimResult simulateDischarge(bool governed) {
+    SimResult result = {};
+    double charge = SIM_CAPACITY_MAH;
+    time_t now = 1760000000;
+    time_t lastNtpAttempt = NTP_NEVER_ATTEMPTED;
+    PowerTier tier = PowerTier::NORMAL; // Kept across wakes like the RTC copy in PowerClass::begin
+    uint32_t noise = 12345;
+
+    while (charge > 0) {
+        double trueSoc = charge * 100 / SIM_CAPACITY_MAH;
+
+        // The governor decides at boot, on the average of a few noisy voltage readings (see PowerClass::begin)
+        if (governed) {
+            float offset = 0;
+            for (int i = 0; i < SIM_BOOT_SAMPLES; i++) {
+                noise = noise * 1103515245 + 12345;
+                offset += ((int)((noise >> 16) % 2001) - 1000) / 1000.0f * SIM_ADC_NOISE_V / SIM_BOOT_SAMPLES;
+            }
+            PowerTier newTier = PowerClass::selectTier(tier, PowerClass::voltageToSoc(socToVoltage(trueSoc) + offset));
+            if (newTier != tier) result.tierChanges++;
+            tier = newTier;
+        }
+        const PowerPolicy& p = PowerClass::policyOf(tier);
+
+        bool ntpAttempt = ServerClass::ntpSyncDue(p, now, lastNtpAttempt);
+        if (ntpAttempt) {
+            lastNtpAttempt = now;
+            result.ntpAttempts++;
+        }
+
+        // Band of the true state of charge, by the tier thresholds
+        int band = (int)PowerTier::CRITICAL;
+        while (band > 0 && trueSoc >= PowerClass::policyOf((PowerTier)(band - 1)).minSoc) band--;
+
+        double hours = 24.0 / SIM_WAKES_PER_DAY;
+        result.bandHours[band] += hours;
+        result.runtimeHours += hours;
+        charge -= cycleCharge(p, ntpAttempt);
+        now += hours * 3600;
+    }
+    return result;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_voltage_to_soc() {
+    TEST_ASSERT_EQUAL(100, PowerClass::voltageToSoc(4.25f));
+    TEST_ASSERT_EQUAL(0, PowerClass::voltageToSoc(3.2f));
+    TEST_ASSERT_EQUAL(50, PowerClass::voltageToSoc(3.80f));
+    uint8_t last = 0;
+    for (float v = 3.3f; v <= 4.2f; v += 0.005f) {
+        uint8_t soc = PowerClass::voltageToSoc(v);
+        TEST_ASSERT_GREATER_OR_EQUAL(last, soc);
+        last = soc;
+    }
+}
+
+void test_select_tier_hysteresis() {
+    // Down right away
+    TEST_ASSERT_EQUAL((int)PowerTier::SAVING, (int)PowerClass::selectTier(PowerTier::NORMAL, 49));
+    TEST_ASSERT_EQUAL((int)PowerTier::CRITICAL, (int)PowerClass::selectTier(PowerTier::NORMAL, 5));
+    // Up only with the margin
+    TEST_ASSERT_EQUAL((int)PowerTier::SAVING, (int)PowerClass::selectTier(PowerTier::SAVING, 51));
+    TEST_ASSERT_EQUAL((int)PowerTier::NORMAL, (int)PowerClass::selectTier(PowerTier::SAVING, 53));
+    TEST_ASSERT_EQUAL((int)PowerTier::LOW_BATTERY, (int)PowerClass::selectTier(PowerTier::CRITICAL, 24));
+}
+
+void test_ntp_attempt_rate_limit() {
+    const PowerPolicy& normal = PowerClass::policyOf(PowerTier::NORMAL);
+    const PowerPolicy& saving = PowerClass::policyOf(PowerTier::SAVING);
+    const PowerPolicy& critical = PowerClass::policyOf(PowerTier::CRITICAL);
+    time_t now = 1760000000;
+
+    TEST_ASSERT_TRUE(ServerClass::ntpSyncDue(normal, now, now - 10));
+    TEST_ASSERT_TRUE(ServerClass::ntpSyncDue(saving, now, NTP_NEVER_ATTEMPTED));
+    TEST_ASSERT_FALSE(ServerClass::ntpSyncDue(saving, now, now - 3600));    // A failed attempt an hour ago
+    TEST_ASSERT_TRUE(ServerClass::ntpSyncDue(saving, now, now - 7 * 3600));
+    TEST_ASSERT_TRUE(ServerClass::ntpSyncDue(saving, now, now + 3600));     // Clock set back
+    TEST_ASSERT_FALSE(ServerClass::ntpSyncDue(critical, now, NTP_NEVER_ATTEMPTED)); // Never means never
+    TEST_ASSERT_FALSE(ServerClass::ntpSyncDue(critical, now, now - 30 * 24 * 3600));
+}
+
+// Raw ADC reading of a battery voltage (behind the 1:2 divider)
+static uint16_t batteryReading(float voltage) {
+    return (uint16_t)(voltage / 6.6f * 4095 + 0.5f);
+}
+
+void test_tier_survives_deep_sleep() {
+    extern InputClass input;
+    PowerClass governor(input);
+
+    // 40 %: SAVING
+        shimResetReason = ESP_RST_POWERON;
+        shimAnalogValue = batteryReading(3.75f);
+        governor.begin();
+        TEST_ASSERT_EQUAL((int)PowerTier::SAVING, (int)governor.tier());
+
+    // 51 % after a wakeup is within the hysteresis, the tier of the last boot stays
+        shimResetReason = ESP_RST_DEEPSLEEP;
+        shimAnalogValue = batteryReading(3.807f);
+        governor.begin();
+        TEST_ASSERT_EQUAL(51, governor.stateOfCharge());
+        TEST_ASSERT_EQUAL((int)PowerTier::SAVING, (int)governor.tier());
+
+    // Power on starts over from NORMAL
+        shimResetReason = ESP_RST_POWERON;
+        governor.begin();
+        TEST_ASSERT_EQUAL((int)PowerTier::NORMAL, (int)governor.tier());
+
+    // Enough margin after a wakeup moves back up
+        shimResetReason = ESP_RST_DEEPSLEEP;
+        shimAnalogValue = batteryReading(3.75f);
+        governor.begin();
+        shimAnalogValue = batteryReading(3.85f);
+        governor.begin();
+        TEST_ASSERT_EQUAL((int)PowerTier::NORMAL, (int)governor.tier());
+
+    shimResetReason = ESP_RST_POWERON;
+    shimAnalogValue = 0;
+}
+
+void test_discharge_simulation() {
+    SimResult normal = simulateDischarge(false);
+    SimResult governed = simulateDischarge(true);
+
+    printf("Discharge simulation, %.0f mAh, %d wakes a day:\n", SIM_CAPACITY_MAH, SIM_WAKES_PER_DAY);
+    printf(" %-12s %12s %12s %12s\n", "SoC band", "NORMAL (h)", "governed (h)", "extra (h)");
+    static const char* names[] = {"NORMAL", "SAVING", "LOW_BATTERY", "CRITICAL"};
+    for (int i = 0; i < 4; i++) {
+        printf(" %-12s %12.0f %12.0f %+12.0f\n", names[i], normal.bandHours[i], governed.bandHours[i],
+            governed.bandHours[i] - normal.bandHours[i]);
+    }
+    printf(" %-12s %12.0f %12.0f %+12.0f (%.1f -> %.1f days)\n", "total", normal.runtimeHours, governed.runtimeHours,
+        governed.runtimeHours - normal.runtimeHours, normal.runtimeHours / 24, governed.runtimeHours / 24);
+    printf(" NTP attempts: %u -> %u, tier changes: %u\n", (unsigned)normal.ntpAttempts, (unsigned)governed.ntpAttempts,
+        (unsigned)governed.tierChanges);
+
+    // Every tier below NORMAL stretches its band, the NORMAL band itself is unchanged
+    TEST_ASSERT_EQUAL(normal.bandHours[0], governed.bandHours[0]);
+    for (int i = 1; i < 4; i++) {
+        TEST_ASSERT_GREATER_THAN(normal.bandHours[i], governed.bandHours[i]);
+    }
+    // The hysteresis keeps the ADC noise from flapping between tiers: straight down, one change per tier
+    TEST_ASSERT_EQUAL(3, governed.tierChanges);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_voltage_to_soc);
+    RUN_TEST(test_select_tier_hysteresis);
+    RUN_TEST(test_ntp_attempt_rate_limit);
+    RUN_TEST(test_tier_survives_deep_sleep);
+    RUN_TEST(test_discharge_simulation);
+    return UNITY_END();
+}
@@ -0,0 +1,195 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include <WebServer.h>
+#include <sleep_system.hpp>
+#include <server.hpp>
+// Schedule tests (native only): next wakeup with weekday masks, the stored schedule file and the upload route.
+
+extern SleepSystemClass sleepSystem;
+extern InputClass input;
+extern ServerClass server;
+extern WebServer webServer;
+
+// POSTs a schedule upload chunk, returns the status code
+static int upload(uint32_t offset, uint32_t total, const std::string& body, const char* type = "application/cbor") {
+    webServer.request(HTTP_POST, "/schedule", {{"offset", std::to_string(offset)}, {"total", std::to_string(total)}},
+                      {{"Content-Type", type}}, body);
+    return webServer.responseCode;
+}
+
+#define WEEKDAY(day) (1 << (day))
+enum { SUNDAY, MONDAY, TUESDAY, WEDNESDAY, THURSDAY, FRIDAY, SATURDAY };
+
+// Local time of a date (UTC in the tests)
+static struct tm dateTime(int year, int month, int day, int hour, int minute) {
+    struct tm t = {};
+    t.tm_year = year - 1900;
+    t.tm_mon = month - 1;
+    t.tm_mday = day;
+    t.tm_hour = hour;
+    t.tm_min = minute;
+    t.tm_isdst = -1;
+    mktime(&t); // Fills in tm_wday
+    return t;
+}
+
+void setUp() {
+    LittleFS.format();
+    input.data.compartmentCount = 8;
+}
+void tearDown() {}
+
+void test_next_wakeup_every_day() {
+    const WakeTimestamp schedule[] = {{8, 0, 0, WEEKDAYS_ALL}, {20, 0, 1, WEEKDAYS_ALL}};
+    TEST_ASSERT_TRUE(sleepSystem.setSchedule(schedule, 2));
+
+    // 2026-10-14 is a Wednesday
+    struct tm now = dateTime(2026, 10, 14, 9, 0);
+    struct tm expected = dateTime(2026, 10, 14, 20, 0);
+    uint32_t compartments;
+    TEST_ASSERT_EQUAL(mktime(&expected), sleepSystem.nextWakeup(now, compartments));
+    TEST_ASSERT_EQUAL(1 << 1, compartments);
+
+    now = dateTime(2026, 10, 14, 21, 0);
+    expected = dateTime(2026, 10, 15, 8, 0);
+    TEST_ASSERT_EQUAL(mktime(&expected), sleepSystem.nextWakeup(now, compartments));
+    TEST_ASSERT_EQUAL(1 << 0, compartments);
+}
+
+void test_next_wakeup_weekdays() {
+    const WakeTimestamp schedule[] = {
+        {8, 0, 0, WEEKDAY(MONDAY) | WEEKDAY(FRIDAY)},
+        {8, 0, 1, WEEKDAY(SATURDAY)},
+        {8, 0, 2, WEEKDAY(FRIDAY)},
+    };
+    TEST_ASSERT_TRUE(sleepSystem.setSchedule(schedule, 3));
+    uint32_t compartments;
+
+    // Wednesday 09:00: Friday 08:00, compartments 0 and 2
+    struct tm now = dateTime(2026, 10, 14, 9, 0);
+    struct tm expected = dateTime(2026, 10, 16, 8, 0);
+    TEST_ASSERT_EQUAL(mktime(&expected), sleepSystem.nextWakeup(now, compartments));
+    TEST_ASSERT_EQUAL((1 << 0) | (1 << 2), compartments);
+
+    // Saturday 09:00, after Saturday's dose: Monday 08:00
+    now = dateTime(2026, 10, 17, 9, 0);
+    expected = dateTime(2026, 10, 19, 8, 0);
+    TEST_ASSERT_EQUAL(mktime(&expected), sleepSystem.nextWakeup(now, compartments));
+    TEST_ASSERT_EQUAL(1 << 0, compartments);
+
+    // Only a Monday dose, Monday 09:00: a week later
+    const WakeTimestamp weekly[] = {{8, 0, 3, WEEKDAY(MONDAY)}};
+    TEST_ASSERT_TRUE(sleepSystem.setSchedule(weekly, 1));
+    now = dateTime(2026, 10, 19, 9, 0);
+    expected = dateTime(2026, 10, 26, 8, 0);
+    TEST_ASSERT_EQUAL(mktime(&expected), sleepSystem.nextWakeup(now, compartments));
+    TEST_ASSERT_EQUAL(1 << 3, compartments);
+}
+
+void test_schedule_file() {
+    const WakeTimestamp schedule[] = {{8, 30, 0, WEEKDAY(MONDAY)}, {21, 0, 5, WEEKDAYS_ALL}};
+    TEST_ASSERT_TRUE(sleepSystem.setSchedule(schedule, 2));
+
+    // Version, count and the entries with their weekdays
+    const uint8_t stored[] = {0xA2, 2, 8, 30, 0, WEEKDAY(MONDAY), 21, 0, 5, WEEKDAYS_ALL};
+    TEST_ASSERT_EQUAL(sizeof(stored), LittleFS.files["/schedule.bin"]->size());
+    TEST_ASSERT_TRUE(memcmp(stored, LittleFS.files["/schedule.bin"]->data(), sizeof(stored)) == 0);
+}
+
+void test_schedule_file_version_1() {
+    // Count, then hour, minute and compartment: loaded as every day doses
+    const uint8_t stored[] = {2, 7, 0, 1, 19, 45, 2};
+    File file = LittleFS.open("/schedule.bin", "w");
+    file.write(stored, sizeof(stored));
+    file.close();
+
+    sleepSystem.begin(); // Loads the stored schedule
+    TEST_ASSERT_EQUAL(2, sleepSystem.getScheduleCount());
+    WakeTimestamp entry = sleepSystem.getScheduleEntry(1);
+    TEST_ASSERT_EQUAL(19, entry.hour);
+    TEST_ASSERT_EQUAL(45, entry.minute);
+    TEST_ASSERT_EQUAL(2, entry.compartment);
+    TEST_ASSERT_EQUAL(WEEKDAYS_ALL, entry.weekdays);
+}
+
+void test_upload() {
+    // Two chunks of one entry: [7, 15, 1] and [22, 0, 2, Monday]
+    TEST_ASSERT_EQUAL(200, upload(0, 2, std::string("\x81\x83\x07\x0F\x01", 5)));
+    TEST_ASSERT_EQUAL(200, upload(1, 2, std::string("\x81\x84\x16\x00\x02\x02", 6)));
+    TEST_ASSERT_EQUAL(2, sleepSystem.getScheduleCount());
+    TEST_ASSERT_EQUAL(22, sleepSystem.getScheduleEntry(1).hour);
+    TEST_ASSERT_EQUAL(WEEKDAY(MONDAY), sleepSystem.getScheduleEntry(1).weekdays);
+}
+
+void test_upload_count_overflow() {
+    TEST_ASSERT_EQUAL(200, upload(0, 2, std::string("\x81\x83\x07\x00\x00", 5)));
+
+    // An array of 0xFFFFFFFF entries (1 + count wraps to 0), followed by more entries than the stage holds
+    std::string body("\x9A\xFF\xFF\xFF\xFF", 5);
+    for (int i = 0; i < MAX_SCHEDULE_ENTRIES + 8; i++) body += std::string("\x83\x08\x00\x00", 4);
+    TEST_ASSERT_EQUAL(400, upload(1, 2, body));
+
+    // Nothing was staged, the upload continues at the same offset
+    TEST_ASSERT_EQUAL(200, upload(1, 2, std::string("\x81\x83\x09\x00\x00", 5)));
+    TEST_ASSERT_EQUAL(2, sleepSystem.getScheduleCount());
+    TEST_ASSERT_EQUAL(9, sleepSystem.getScheduleEntry(1).hour);
+}
+
+void test_upload_invalid_entry() {
+    // Second entry has hour 24: the whole chunk is rejected
+    TEST_ASSERT_EQUAL(400, upload(0, 2, std::string("\x82\x83\x07\x00\x00\x83\x18\x18\x00\x00", 10)));
+    TEST_ASSERT_EQUAL(409, upload(1, 2, std::string("\x81\x83\x07\x00\x00", 5))); // Still at offset 0
+}
+
+void test_upload_json() {
+    TEST_ASSERT_EQUAL(200, upload(0, 3, " [ [6,5,0], [18, 30, 1, 65] ]\n", "application/json; charset=utf-8"));
+    TEST_ASSERT_EQUAL(200, upload(2, 3, "[[23,59,31,127]]", "application/json"));
+    TEST_ASSERT_EQUAL(3, sleepSystem.getScheduleCount());
+    WakeTimestamp entry = sleepSystem.getScheduleEntry(1);
+    TEST_ASSERT_EQUAL(18, entry.hour);
+    TEST_ASSERT_EQUAL(30, entry.minute);
+    TEST_ASSERT_EQUAL(WEEKDAY(SUNDAY) | WEEKDAY(SATURDAY), entry.weekdays);
+    TEST_ASSERT_EQUAL(WEEKDAYS_ALL, sleepSystem.getScheduleEntry(0).weekdays);
+
+    // Malformed, out of range, too many fields, more entries than announced, trailing garbage
+    TEST_ASSERT_EQUAL(400, upload(0, 1, "[[6,5]]", "application/json"));
+    TEST_ASSERT_EQUAL(400, upload(0, 1, "[[24,0,0]]", "application/json"));
+    TEST_ASSERT_EQUAL(400, upload(0, 1, "[[6,5,0,1,2]]", "application/json"));
+    TEST_ASSERT_EQUAL(400, upload(0, 1, "[[6,5,0],[7,0,0]]", "application/json"));
+    TEST_ASSERT_EQUAL(400, upload(0, 1, "[[6,5,0]]x", "application/json"));
+    TEST_ASSERT_EQUAL(400, upload(0, 1, "[[6,5,-1]]", "application/json"));
+}
+
+void test_upload_content_type() {
+    TEST_ASSERT_EQUAL(415, upload(0, 1, std::string("\x81\x83\x07\x00\x00", 5), "text/plain"));
+    TEST_ASSERT_EQUAL(415, upload(0, 1, std::string("\x81\x83\x07\x00\x00", 5), ""));
+}
+
+void test_upload_body_not_reused() {
+    // A chunk, then the next one without a body: the first body must not be staged again
+    TEST_ASSERT_EQUAL(200, upload(0, 2, std::string("\x81\x83\x07\x00\x00", 5)));
+    TEST_ASSERT_EQUAL(400, upload(1, 2, ""));
+    TEST_ASSERT_EQUAL(200, upload(1, 2, std::string("\x81\x83\x08\x00\x00", 5)));
+    TEST_ASSERT_EQUAL(8, sleepSystem.getScheduleEntry(1).hour);
+}
+
+int main() {
+    setenv("TZ", "UTC0", 1);
+    tzset();
+
+    server.begin(); // Registers the routes (no network on the host)
+
+    UNITY_BEGIN();
+    RUN_TEST(test_next_wakeup_every_day);
+    RUN_TEST(test_next_wakeup_weekdays);
+    RUN_TEST(test_schedule_file);
+    RUN_TEST(test_schedule_file_version_1);
+    RUN_TEST(test_upload);
+    RUN_TEST(test_upload_count_overflow);
+    RUN_TEST(test_upload_invalid_entry);
+    RUN_TEST(test_upload_json);
+    RUN_TEST(test_upload_content_type);
+    RUN_TEST(test_upload_body_not_reused);
+    return UNITY_END();
+}
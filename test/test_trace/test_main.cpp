@@ -0,0 +1,185 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include <vector>
+#include <esp_system.h>
+#include <trace.hpp>
+// Trace buffer tests (native only, the core comes from shimCoreId):
+//  - Packing of the record source (core, task, event) and the fields of exported records.
+//  - Every core keeps the last TRACE_RING_SIZE records of its own ring, in order, whatever the other core writes.
+//  - The dump after a crash is deferred to dumpCrash() and written once.
+
+// Collects everything written to it
+class StringPrint : public Print {
+public:
+    std::string text;
+    size_t write(uint8_t c) override {
+        text += (char)c;
+        return 1;
+    }
+};
+
+extern TraceClass trace;
+
+struct ExportedEvent {
+    std::string name;
+    unsigned long long ts;
+    unsigned pid, tid, value, core;
+};
+
+// Events of the exported JSON in export order, without the metadata
+static std::vector<ExportedEvent> exportEvents() {
+    StringPrint out;
+    trace.exportChromeJson(out);
+    TEST_ASSERT_EQUAL(0, out.text.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+    TEST_ASSERT_EQUAL(out.text.size() - 2, out.text.rfind("]}"));
+
+    std::vector<ExportedEvent> events;
+    for (size_t pos = out.text.find("{\"name\":\""); pos != std::string::npos; pos = out.text.find("{\"name\":\"", pos + 1)) {
+        char name[32];
+        ExportedEvent event;
+        if (sscanf(out.text.c_str() + pos, "{\"name\":\"%31[^\"]\",\"ph\":\"%*[BEiC]\",\"s\":\"t\",\"ts\":%llu,\"pid\":%u,\"tid\":%u,\"args\":{\"value\":%u,\"core\":%u}}",
+                name, &event.ts, &event.pid, &event.tid, &event.value, &event.core) != 6) continue;
+        event.name = name;
+        events.push_back(event);
+    }
+    return events;
+}
+
+void setUp() {
+    shimCoreId = 0;
+    shimResetReason = ESP_RST_POWERON;
+    trace.begin();
+}
+
+void tearDown() {
+    shimCoreId = 0;
+}
+
+void test_source_packing() {
+    TEST_ASSERT_EQUAL(12, sizeof(TraceRecord));
+    for (uint8_t core = 0; core < 2; core++) {
+        for (uint8_t task = 0; task < 8; task++) {
+            for (uint8_t event = 0; event < 16; event++) {
+                uint8_t source = TRACE_SOURCE(core, task, event);
+                TEST_ASSERT_EQUAL(core, TRACE_SOURCE_CORE(source));
+                TEST_ASSERT_EQUAL(task, TRACE_SOURCE_TASK(source));
+                TEST_ASSERT_EQUAL(event, TRACE_SOURCE_EVENT(source));
+            }
+        }
+    }
+}
+
+void test_record_fields() {
+    int64_t before = esp_timer_get_time();
+    shimCoreId = 1;
+    trace.record(TraceTask::INPUT_TASK, TraceEvent::HATCH_EDGE, 1);
+    shimCoreId = 0;
+    trace.record(TraceTask::SERVER_TASK, TraceEvent::REQUEST_BEGIN, 0xFFFFFFFF); // Full 32 bit payload
+    int64_t after = esp_timer_get_time();
+
+    // Core 0 first (the boot record, then the request), then core 1, all of the first run since power on
+    std::vector<ExportedEvent> events = exportEvents();
+    TEST_ASSERT_EQUAL(3, events.size());
+
+    TEST_ASSERT_EQUAL_STRING("BOOT", events[0].name.c_str());
+    TEST_ASSERT_EQUAL((int)TraceTask::SETUP, events[0].tid);
+    TEST_ASSERT_EQUAL(ESP_RST_POWERON, events[0].value);
+
+    TEST_ASSERT_EQUAL_STRING("REQUEST", events[1].name.c_str());
+    TEST_ASSERT_EQUAL((int)TraceTask::SERVER_TASK, events[1].tid);
+    TEST_ASSERT_EQUAL(0xFFFFFFFF, events[1].value);
+    TEST_ASSERT_EQUAL(0, events[1].core);
+
+    TEST_ASSERT_EQUAL_STRING("HATCH_EDGE", events[2].name.c_str());
+    TEST_ASSERT_EQUAL((int)TraceTask::INPUT_TASK, events[2].tid);
+    TEST_ASSERT_EQUAL(1, events[2].value);
+    TEST_ASSERT_EQUAL(1, events[2].core);
+
+    for (const ExportedEvent& event : events) TEST_ASSERT_EQUAL(1, event.pid);
+    TEST_ASSERT_TRUE(events[0].ts <= events[1].ts);
+    TEST_ASSERT_TRUE(events[1].ts >= (unsigned long long)before && events[1].ts <= (unsigned long long)after);
+    TEST_ASSERT_TRUE(events[2].ts >= (unsigned long long)before && events[2].ts <= events[1].ts);
+}
+
+void test_rings_wrap_per_core() {
+    // Core 0 writes past its ring (the boot record is overwritten), core 1 only a few records
+    const uint32_t written = TRACE_RING_SIZE + 5;
+    for (uint32_t i = 0; i < written; i++) {
+        shimCoreId = 0;
+        trace.record(TraceTask::OUTPUT_WORKER, TraceEvent::OUTPUT_STATE, i);
+        if (i < 3) {
+            shimCoreId = 1;
+            trace.record(TraceTask::INPUT_TASK, TraceEvent::COMPARTMENT_EDGE, 1000 + i);
+        }
+    }
+
+    std::vector<ExportedEvent> events = exportEvents();
+    TEST_ASSERT_EQUAL(TRACE_RING_SIZE + 3, events.size());
+
+    // The newest TRACE_RING_SIZE of core 0, oldest first
+    for (uint32_t i = 0; i < TRACE_RING_SIZE; i++) {
+        TEST_ASSERT_EQUAL_STRING("OUTPUT_STATE", events[i].name.c_str());
+        TEST_ASSERT_EQUAL(0, events[i].core);
+        TEST_ASSERT_EQUAL(written - TRACE_RING_SIZE + i, events[i].value);
+        if (i > 0) TEST_ASSERT_TRUE(events[i - 1].ts <= events[i].ts);
+    }
+
+    // All of core 1, untouched by the wrap of core 0
+    for (uint32_t i = 0; i < 3; i++) {
+        const ExportedEvent& event = events[TRACE_RING_SIZE + i];
+        TEST_ASSERT_EQUAL_STRING("COMPARTMENT_EDGE", event.name.c_str());
+        TEST_ASSERT_EQUAL(1, event.core);
+        TEST_ASSERT_EQUAL(1000 + i, event.value);
+    }
+}
+
+void test_crash_dump_is_deferred() {
+    trace.record(TraceTask::SLEEP_SYSTEM, TraceEvent::SLEEP_COUNTDOWN, 7);
+
+    // Software reset: no dump, the buffer keeps both runs
+        shimResetReason = ESP_RST_SW;
+        trace.begin();
+        StringPrint none;
+        trace.dumpCrash(none);
+        TEST_ASSERT_EQUAL(0, none.text.size());
+
+    // Watchdog reset: begin() only remembers it, dumpCrash() writes all three runs once
+        trace.record(TraceTask::OUTPUT_WORKER, TraceEvent::OUTPUT_STATE, 3);
+        shimResetReason = ESP_RST_TASK_WDT;
+        trace.begin();
+
+        StringPrint dump;
+        trace.dumpCrash(dump);
+        StringPrint full;
+        trace.exportChromeJson(full);
+        TEST_ASSERT_EQUAL_STRING(full.text.c_str(), dump.text.c_str());
+        for (const char* boot : {"\"name\":\"Boot 1\"", "\"name\":\"Boot 2\"", "\"name\":\"Boot 3\""}) {
+            TEST_ASSERT_TRUE(dump.text.find(boot) != std::string::npos);
+        }
+
+        std::vector<ExportedEvent> events = exportEvents();
+        TEST_ASSERT_EQUAL(5, events.size());
+        TEST_ASSERT_EQUAL(2, events[2].pid);
+        TEST_ASSERT_EQUAL(ESP_RST_SW, events[2].value);
+        TEST_ASSERT_EQUAL(3, events[4].pid);
+        TEST_ASSERT_EQUAL(ESP_RST_TASK_WDT, events[4].value);
+
+        StringPrint again;
+        trace.dumpCrash(again);
+        TEST_ASSERT_EQUAL(0, again.text.size());
+
+    // Power on: the RTC buffer starts over
+        shimResetReason = ESP_RST_POWERON;
+        trace.begin();
+        TEST_ASSERT_EQUAL(1, exportEvents().size());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_source_packing);
+    RUN_TEST(test_record_fields);
+    RUN_TEST(test_rings_wrap_per_core);
+    RUN_TEST(test_crash_dump_is_deferred);
+    return UNITY_END();
+}
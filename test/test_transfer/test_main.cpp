@@ -0,0 +1,260 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include <WebServer.h>
+#include <malloc.h>
+#include <new>
+#include <string>
+#include <vector>
+#include <cbor.hpp>
+#include <dose_log.hpp>
+#include <server.hpp>
+#include <sleep_system.hpp>
+// Bulk transfer tests (native only):
+//  - GET /log paging with from / count / next, in JSON and CBOR, also past the dropped oldest half.
+//  - Resuming a download after the connection dropped at any byte, from the last complete entry.
+//  - Heap high-water mark of a dose log download and a schedule upload. The firmware's own allocations are counted
+//    (global operator new), the shim keeps no response body while measuring.
+
+extern DoseLogClass doseLog;
+extern ServerClass server;
+extern WebServer webServer;
+
+#define LOG_ENTRIES 100
+#define LOG_PAGE_MAX 1024 // LOG_PAGE_MAX_ENTRIES
+#define SCHEDULE_CHUNK_BYTES 1024 // SCHEDULE_CHUNK_MAX_BYTES
+
+// Heap tracking
+    static size_t heapInUse = 0;
+    static size_t heapPeak = 0;
+
+    void* operator new(size_t size) {
+        void* p = malloc(size);
+        if (!p) throw std::bad_alloc();
+        heapInUse += malloc_usable_size(p);
+        if (heapInUse > heapPeak) heapPeak = heapInUse;
+        return p;
+    }
+    void* operator new[](size_t size) { return operator new(size); }
+    void operator delete(void* p) noexcept {
+        if (!p) return;
+        heapInUse -= malloc_usable_size(p);
+        free(p);
+    }
+    void operator delete[](void* p) noexcept { operator delete(p); }
+    void operator delete(void* p, size_t) noexcept { operator delete(p); }
+    void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+    // Runs a request, returns the most heap it allocated on top of what was in use before. A previous request with
+    // the same arguments and headers leaves the shim's copies of them in place, so only the handler's allocations count.
+    static size_t heapHighWater(HTTPMethod method, const char* uri, const std::map<std::string, std::string>& args,
+                                const std::map<std::string, std::string>& headers, const std::string& body = "") {
+        webServer.keepResponseBody = false;
+        size_t before = heapInUse;
+        heapPeak = before;
+        webServer.request(method, uri, args, headers, body);
+        webServer.keepResponseBody = true;
+        return heapPeak - before;
+    }
+
+struct LogPage {
+    uint32_t from;
+    uint32_t next;
+    std::vector<DoseLogEntry> entries;
+};
+
+static void getLog(uint32_t from, uint32_t count, bool cbor) {
+    webServer.request(HTTP_GET, "/log", {{"from", std::to_string(from)}, {"count", std::to_string(count)}},
+                      cbor ? std::map<std::string, std::string>{{"Accept", CBOR_CONTENT_TYPE}} : std::map<std::string, std::string>{});
+    TEST_ASSERT_EQUAL(200, webServer.responseCode);
+}
+
+static LogPage parseJson(const std::string& body) {
+    LogPage page = {};
+    const char* c = body.c_str();
+    int length;
+    TEST_ASSERT_EQUAL(1, sscanf(c, "{\"from\":%u,\"entries\":[%n", &page.from, &length));
+    c += length;
+    unsigned time;
+    int event, compartment;
+    while (sscanf(c, "%*[,][%u,%d,%d]%n", &time, &event, &compartment, &length) == 3 ||
+           sscanf(c, "[%u,%d,%d]%n", &time, &event, &compartment, &length) == 3) {
+        page.entries.push_back({time, (uint8_t)event, (uint8_t)compartment, 0});
+        c += length;
+    }
+    TEST_ASSERT_EQUAL(1, sscanf(c, "],\"next\":%u}", &page.next));
+    return page;
+}
+
+// Decodes a CBOR page, a cut off body gives the entries that arrived completely (next stays 0)
+static LogPage parseCbor(const std::string& body) {
+    LogPage page = {};
+    CborReader head((const uint8_t*)body.data(), body.size());
+    uint32_t pairs;
+    char key[8];
+    if (!head.readMap(pairs) || !head.readString(key, sizeof(key)) || !head.readUint(page.from)) return page;
+
+    // The entries are an indefinite length array (the reader only takes definite ones), skip its head
+    struct : Print {
+        size_t length = 0;
+        size_t write(uint8_t) override { return ++length, 1; }
+    } headLength;
+    CborWriter writer(headLength);
+    writer.beginMap(3);
+    writer.writeString("from");
+    writer.writeUint(page.from);
+    writer.writeString("entries");
+    writer.beginIndefiniteArray();
+    if (body.size() < headLength.length) return page;
+
+    CborReader reader((const uint8_t*)body.data() + headLength.length, body.size() - headLength.length);
+    uint32_t count, time, event, compartment;
+    while (reader.readArray(count) && count == 3 && reader.readUint(time) && reader.readUint(event) && reader.readUint(compartment)) {
+        page.entries.push_back({time, (uint8_t)event, (uint8_t)compartment, 0});
+    }
+
+    // Break, then "next"
+    size_t end = headLength.length + 1;
+    for (const DoseLogEntry& entry : page.entries) {
+        end += 1 + (entry.time < 24 ? 1 : entry.time <= 0xFF ? 2 : entry.time <= 0xFFFF ? 3 : 5) + 2;
+    }
+    if (end <= body.size() && (uint8_t)body[end - 1] == 0xFF) {
+        CborReader tail((const uint8_t*)body.data() + end, body.size() - end);
+        if (!tail.readString(key, sizeof(key)) || !tail.readUint(page.next)) page.next = 0;
+    }
+    return page;
+}
+
+static void assertEntries(uint32_t from, const std::vector<DoseLogEntry>& entries) {
+    for (size_t i = 0; i < entries.size(); i++) {
+        uint32_t sequence = from + i;
+        TEST_ASSERT_EQUAL((int)DoseEvent::TAKEN, entries[i].event);
+        TEST_ASSERT_EQUAL(sequence % 8, entries[i].compartment);
+    }
+}
+
+void setUp() {
+    LittleFS.format();
+    doseLog.begin();
+    for (uint32_t i = 0; i < LOG_ENTRIES; i++) {
+        doseLog.append(DoseEvent::TAKEN, i % 8);
+    }
+}
+
+void tearDown() {}
+
+void test_log_paging() {
+    for (int cbor = 0; cbor <= 1; cbor++) {
+        // Pages of 40 follow "next" to the end
+        uint32_t from = 0;
+        uint32_t received = 0;
+        for (int page = 0; page < 3; page++) {
+            getLog(from, 40, cbor);
+            TEST_ASSERT_EQUAL_STRING(cbor ? CBOR_CONTENT_TYPE : "application/json", webServer.responseType.c_str());
+            LogPage result = cbor ? parseCbor(webServer.responseBody) : parseJson(webServer.responseBody);
+            TEST_ASSERT_EQUAL(from, result.from);
+            TEST_ASSERT_EQUAL(page < 2 ? 40 : 20, result.entries.size());
+            TEST_ASSERT_EQUAL(from + result.entries.size(), result.next);
+            assertEntries(from, result.entries);
+            received += result.entries.size();
+            from = result.next;
+        }
+        TEST_ASSERT_EQUAL(LOG_ENTRIES, received);
+
+        // At the end: an empty page that stays there
+        getLog(from, 40, cbor);
+        LogPage end = cbor ? parseCbor(webServer.responseBody) : parseJson(webServer.responseBody);
+        TEST_ASSERT_EQUAL(0, end.entries.size());
+        TEST_ASSERT_EQUAL(LOG_ENTRIES, end.next);
+    }
+
+    // Without a count a page holds up to LOG_PAGE_MAX_ENTRIES, a larger count is capped
+        webServer.request(HTTP_GET, "/log");
+        TEST_ASSERT_EQUAL(LOG_ENTRIES, parseJson(webServer.responseBody).entries.size());
+        for (uint32_t i = LOG_ENTRIES; i < LOG_PAGE_MAX + 10; i++) doseLog.append(DoseEvent::TAKEN, i % 8);
+        getLog(0, 5000, false);
+        TEST_ASSERT_EQUAL(LOG_PAGE_MAX, parseJson(webServer.responseBody).entries.size());
+}
+
+void test_log_paging_after_compaction() {
+    // Fill the log until the oldest half is dropped, a download that was behind continues with the oldest entry left
+    for (uint32_t i = LOG_ENTRIES; i <= DOSE_LOG_CAPACITY; i++) doseLog.append(DoseEvent::TAKEN, i % 8);
+    TEST_ASSERT_EQUAL(DOSE_LOG_CAPACITY / 2, doseLog.firstSequence());
+
+    getLog(10, 5, true);
+    LogPage page = parseCbor(webServer.responseBody);
+    TEST_ASSERT_EQUAL(DOSE_LOG_CAPACITY / 2, page.from);
+    TEST_ASSERT_EQUAL(5, page.entries.size());
+    TEST_ASSERT_EQUAL(DOSE_LOG_CAPACITY / 2 + 5, page.next);
+    assertEntries(page.from, page.entries);
+}
+
+void test_log_resume_after_dropped_connection() {
+    getLog(0, LOG_ENTRIES, true);
+    std::string full = webServer.responseBody;
+    TEST_ASSERT_EQUAL(LOG_ENTRIES, parseCbor(full).next);
+
+    // The connection drops after any number of bytes: the client keeps the complete entries and resumes after them
+    for (size_t cut = 0; cut < full.size(); cut++) {
+        LogPage partial = parseCbor(full.substr(0, cut));
+        TEST_ASSERT_EQUAL(0, partial.next);
+
+        uint32_t resumeFrom = partial.entries.size();
+        getLog(resumeFrom, LOG_ENTRIES, true);
+        LogPage rest = parseCbor(webServer.responseBody);
+        TEST_ASSERT_EQUAL(resumeFrom, rest.from);
+        TEST_ASSERT_EQUAL(LOG_ENTRIES, rest.next);
+
+        std::vector<DoseLogEntry> entries = partial.entries;
+        entries.insert(entries.end(), rest.entries.begin(), rest.entries.end());
+        TEST_ASSERT_EQUAL(LOG_ENTRIES, entries.size());
+        assertEntries(0, entries);
+    }
+}
+
+void test_heap_high_water_mark() {
+    for (uint32_t i = LOG_ENTRIES; i < LOG_PAGE_MAX; i++) doseLog.append(DoseEvent::TAKEN, i % 8);
+
+    // Download: streamed in blocks, a full page needs no more heap than a small one
+        webServer.request(HTTP_GET, "/log", {{"count", "1"}}, {{"Accept", CBOR_CONTENT_TYPE}});
+        size_t cbor = heapHighWater(HTTP_GET, "/log", {{"count", "1024"}}, {{"Accept", CBOR_CONTENT_TYPE}});
+        size_t cborLength = webServer.responseLength;
+        webServer.request(HTTP_GET, "/log", {{"count", "1"}}, {});
+        size_t small = heapHighWater(HTTP_GET, "/log", {{"count", "32"}}, {});
+        size_t json = heapHighWater(HTTP_GET, "/log", {{"count", "1024"}}, {});
+        size_t jsonLength = webServer.responseLength;
+
+    // Upload: a full schedule in chunks of 16 entries, the body goes to a static buffer (measured the second time)
+        size_t upload = 0;
+        for (uint32_t chunk = 0; chunk < 2 * MAX_SCHEDULE_ENTRIES / 16; chunk++) {
+            std::string body = "\x90"; // Array of 16
+            for (int i = 0; i < 16; i++) body += std::string("\x83\x07\x00\x00", 4);
+            size_t used = heapHighWater(HTTP_POST, "/schedule",
+                {{"offset", std::to_string(chunk * 16 % MAX_SCHEDULE_ENTRIES)}, {"total", std::to_string(MAX_SCHEDULE_ENTRIES)}},
+                {{"Content-Type", CBOR_CONTENT_TYPE}}, body);
+            TEST_ASSERT_EQUAL(200, webServer.responseCode);
+            if (chunk >= MAX_SCHEDULE_ENTRIES / 16 && used > upload) upload = used;
+        }
+
+    printf("Heap high-water mark (bytes allocated on top of the idle heap):\n");
+    printf(" - GET /log, 32 entries:            %6u\n", (unsigned)small);
+    printf(" - GET /log, 1024 entries JSON:     %6u (%u bytes sent)\n", (unsigned)json, (unsigned)jsonLength);
+    printf(" - GET /log, 1024 entries CBOR:     %6u (%u bytes sent)\n", (unsigned)cbor, (unsigned)cborLength);
+    printf(" - POST /schedule, 16 entry chunk:  %6u\n", (unsigned)upload);
+
+    TEST_ASSERT_EQUAL(small, json);
+    TEST_ASSERT_TRUE(cbor <= json);
+    TEST_ASSERT_TRUE(json < jsonLength / 4);
+    TEST_ASSERT_TRUE(upload < SCHEDULE_CHUNK_BYTES); // The schedule file written by the last chunk, not the body
+}
+
+int main() {
+    server.begin(); // Registers the routes (no network on the host)
+
+    UNITY_BEGIN();
+    RUN_TEST(test_log_paging);
+    RUN_TEST(test_log_paging_after_compaction);
+    RUN_TEST(test_log_resume_after_dropped_connection);
+    RUN_TEST(test_heap_high_water_mark);
+    return UNITY_END();
+}
@@ -0,0 +1,144 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include <sleep_system.hpp>
+#include <output.hpp>
+#include <led.hpp>
+#include <journal.hpp>
+#include <dose_log.hpp>
+// Wakeup tests (native only): a scheduled dose, from going to sleep through the timer wakeup to the dose being taken.
+// Every "boot" calls the modules' begin() again on the same globals, RTC variables keep their values like on the device.
+
+extern SleepSystemClass sleepSystem;
+extern OuptutClass output;
+extern InputClass input;
+extern LedClass led;
+extern JournalClass journal;
+extern DoseLogClass doseLog;
+
+#define COMPARTMENTS 4
+#define DOSE_COMPARTMENT 1
+#define SLEEP_DELAY_S 10 // CONF_SLEEP_DELAY_HATCH_CLOSED_S
+
+static void boot(esp_reset_reason_t reason, esp_sleep_wakeup_cause_t cause) {
+    uint8_t compartments = input.data.compartmentCount;
+    shimResetReason = reason;
+    shimWakeupCause = cause;
+    journal.begin();
+    doseLog.begin();
+    led.begin();
+    output.begin();
+    output.setCompartmentCount(compartments);
+    sleepSystem.begin();
+}
+
+// Runs the sleep system until it puts the device to sleep, false if it stays awake for maxSeconds
+static bool runUntilSleep(int maxSeconds) {
+    for (int i = 0; i < maxSeconds; i++) {
+        try {
+            sleepSystem.step();
+        } catch (const ShimRestart&) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool pixelLit(const CRGB& pixel) {
+    return pixel.r != 0 || pixel.g != 0 || pixel.b != 0;
+}
+
+void setUp() {
+    LittleFS.format();
+    input.data = {};
+    input.data.compartmentCount = COMPARTMENTS;
+
+    // A dose in compartment 1 within the next two minutes, every day
+    time_t doseTime = time(nullptr) + 120;
+    struct tm dose;
+    localtime_r(&doseTime, &dose);
+    WakeTimestamp schedule[] = {{(uint8_t)dose.tm_hour, (uint8_t)dose.tm_min, DOSE_COMPARTMENT, WEEKDAYS_ALL}};
+    TEST_ASSERT_TRUE(sleepSystem.setSchedule(schedule, 1));
+}
+void tearDown() {}
+
+void test_timer_wakeup_lights_due_compartment() {
+    // Power on, nothing due: awake, then asleep once the countdown ran out
+        boot(ESP_RST_POWERON, ESP_SLEEP_WAKEUP_UNDEFINED);
+        TEST_ASSERT_EQUAL((int)OutputState::ON, (int)output.getState());
+        TEST_ASSERT_TRUE(runUntilSleep(SLEEP_DELAY_S));
+        TEST_ASSERT_EQUAL((int)OutputState::OFF, (int)output.getState());
+
+    // The timer wakes us for the dose: alert with the compartment's pixel lit
+        boot(ESP_RST_DEEPSLEEP, ESP_SLEEP_WAKEUP_TIMER);
+        TEST_ASSERT_EQUAL(1 << DOSE_COMPARTMENT, output.getDueCompartments());
+        TEST_ASSERT_EQUAL((int)OutputState::NOTIFICATION_PHASE_1, (int)output.getState());
+
+        CRGB frame[LED_MAX_PIXELS];
+        OuptutClass::renderFrame(frame, output.getState(), output.getDueCompartments(), COMPARTMENTS, 0, 0, 100);
+        for (uint8_t i = 0; i < COMPARTMENTS; i++) {
+            TEST_ASSERT_EQUAL(i == DOSE_COMPARTMENT, pixelLit(frame[1 + i]));
+        }
+        TEST_ASSERT_TRUE(pixelLit(frame[0])); // Breathing status pixel
+
+    // The alert keeps the device awake and escalates
+        TEST_ASSERT_FALSE(runUntilSleep(121));
+        TEST_ASSERT_EQUAL((int)OutputState::NOTIFICATION_PHASE_2, (int)output.getState());
+
+    // Opening the compartment takes the dose, the alert ends and the device goes back to sleep
+        input.data.openCompartments = 1 << DOSE_COMPARTMENT;
+        sleepSystem.step();
+        TEST_ASSERT_EQUAL(0, output.getDueCompartments());
+        TEST_ASSERT_EQUAL((int)OutputState::ON, (int)output.getState());
+
+        input.data.openCompartments = 0;
+        TEST_ASSERT_TRUE(runUntilSleep(SLEEP_DELAY_S));
+}
+
+void test_unanswered_alert_gives_up() {
+    boot(ESP_RST_POWERON, ESP_SLEEP_WAKEUP_UNDEFINED);
+    TEST_ASSERT_TRUE(runUntilSleep(SLEEP_DELAY_S));
+    boot(ESP_RST_DEEPSLEEP, ESP_SLEEP_WAKEUP_TIMER);
+
+    // Four phases, then the countdown runs and the dose stays due for the next wakeup
+    TEST_ASSERT_FALSE(runUntilSleep(4 * 120 - 1));
+    TEST_ASSERT_EQUAL((int)OutputState::NOTIFICATION_PHASE_4, (int)output.getState());
+    TEST_ASSERT_TRUE(runUntilSleep(1 + SLEEP_DELAY_S));
+    TEST_ASSERT_EQUAL(1 << DOSE_COMPARTMENT, journal.state().dueCompartments);
+}
+
+void test_single_hatch_mode() {
+    // No I/O expanders: the dose is due on the single hatch (compartment 0), the status pixel alerts
+        input.data.compartmentCount = 0;
+        boot(ESP_RST_POWERON, ESP_SLEEP_WAKEUP_UNDEFINED);
+        TEST_ASSERT_TRUE(runUntilSleep(SLEEP_DELAY_S));
+        boot(ESP_RST_DEEPSLEEP, ESP_SLEEP_WAKEUP_TIMER);
+        TEST_ASSERT_EQUAL(1 << SINGLE_HATCH_COMPARTMENT, output.getDueCompartments());
+        TEST_ASSERT_EQUAL((int)OutputState::NOTIFICATION_PHASE_1, (int)output.getState());
+        TEST_ASSERT_FALSE(runUntilSleep(SLEEP_DELAY_S + 1));
+
+    // Opening the hatch takes the dose
+        input.data.isHatchOpen = true;
+        sleepSystem.step();
+        TEST_ASSERT_EQUAL(0, output.getDueCompartments());
+        TEST_ASSERT_EQUAL((int)OutputState::ON, (int)output.getState());
+        input.data.isHatchOpen = false;
+        TEST_ASSERT_TRUE(runUntilSleep(SLEEP_DELAY_S));
+
+    // Logged without a compartment id
+        DoseLogEntry entries[4];
+        uint32_t count = doseLog.read(doseLog.firstSequence(), entries, 4);
+        TEST_ASSERT_EQUAL(3, count);
+        TEST_ASSERT_EQUAL((int)DoseEvent::DUE, entries[0].event);
+        TEST_ASSERT_EQUAL((int)DoseEvent::TAKEN, entries[1].event);
+        TEST_ASSERT_EQUAL((int)DoseEvent::HATCH_OPENED, entries[2].event);
+        for (uint32_t i = 0; i < count; i++) TEST_ASSERT_EQUAL(DOSE_LOG_NO_COMPARTMENT, entries[i].compartment);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_timer_wakeup_lights_due_compartment);
+    RUN_TEST(test_unanswered_alert_gives_up);
+    RUN_TEST(test_single_hatch_mode);
+    return UNITY_END();
+}